@@ -3,6 +3,18 @@
 rm -rf shaders
 cp -r ../shaders ./shaders
 cd shaders
-parallel "zsh -c 'glslangValidator -V {} -o {}.spv'" ::: *
+parallel "zsh -c 'glslangValidator -V --target-env vulkan1.2 {} -o {}.spv'" ::: *
+# Water grids built from the vertex index instead of models/grid.obj
+glslangValidator -V --target-env vulkan1.2 -DPROCEDURAL quad.vert -o quad.procedural.vert.spv
+glslangValidator -V --target-env vulkan1.2 -DCLIPMAP quad.vert -o quad.clipmap.vert.spv
+# Reflection and refraction drawn as two views of one pass, and the water reading both layers
+parallel "zsh -c 'glslangValidator -V --target-env vulkan1.2 -DMULTIVIEW {}.vert -o {}.multiview.vert.spv'" ::: base lighting skybox
+glslangValidator -V --target-env vulkan1.2 -DMULTIVIEW quad.frag -o quad.multiview.frag.spv
+# Single channel storage variants of the height field solvers and the ocean
+parallel "zsh -c 'glslangValidator -V --target-env vulkan1.2 -DFORMAT={2} {1} -o {1.}.{2}.comp.spv'" ::: simulation.comp simulation_tiled.comp simulation_blocked.comp simulation_sparse.comp simulation_subgroup.comp simulation_half.comp ocean_height.comp ::: r16f r32f
+# Every state format for the kernels that follow any solver
+parallel "zsh -c 'glslangValidator -V --target-env vulkan1.2 -DFORMAT={2} {1} -o {1.}.{2}.comp.spv'" ::: simulation_normals.comp simulation_splat.comp simulation_rain.comp ::: r16f r32f rg16f
+# The packed kernel in the one storage format every device has
+glslangValidator -V --target-env vulkan1.2 -DFORMAT=rgba16f simulation_packed.comp -o simulation_packed.rgba16f.comp.spv
 find . -type f ! -name '*.spv' -delete
 find . -type f -name '.*' -delete
@@ -1,5 +1,8 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : enable
+#endif
 
 layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 model;
@@ -15,6 +18,8 @@ layout(push_constant) uniform PushConsts {
     vec3 lightSource;
     vec3 lightColor;
     vec3 invert;
+    // The multiview pass draws refraction with clipPlane and reflection with this
+    vec4 reflectionPlane;
 } pushConsts;
 
 layout(location = 0) in vec3 inPosition;
@@ -25,9 +30,17 @@ layout(location = 0) out vec2 fragTexCoord;
 
 void main() {
     vec4 worldPosition = ubo.model * vec4(inPosition, 1.0);
+
+#ifdef MULTIVIEW
+    // View 0 is the refraction, view 1 the reflection
+    bool invert = gl_ViewIndex == 1;
+    gl_ClipDistance[0] = dot(worldPosition, invert ? pushConsts.reflectionPlane : pushConsts.clipPlane);
+#else
+    bool invert = pushConsts.invert.x > 0.5;
     gl_ClipDistance[0] = dot(worldPosition, pushConsts.clipPlane);
+#endif
 
-    if (pushConsts.invert.x > 0.5) {
+    if (invert) {
         gl_Position = ubo.proj * ubo.invertView * worldPosition;
     } else gl_Position = ubo.proj * ubo.view * worldPosition;
 
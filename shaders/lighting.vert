@@ -1,5 +1,8 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : enable
+#endif
 
 layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 model;
@@ -8,6 +11,9 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 invertView;
     mat4 invertModel;
     vec4 cameraPos;
+    vec4 simulation;
+    vec4 gridCamera;
+    mat4 normalMatrix;
 } ubo;
 
 layout(push_constant) uniform PushConsts {
@@ -15,6 +21,8 @@ layout(push_constant) uniform PushConsts {
     vec3 lightSource;
     vec3 lightColor;
     vec3 invert;
+    // The multiview pass draws refraction with clipPlane and reflection with this
+    vec4 reflectionPlane;
 } pushConsts;
 
 layout(location = 0) in vec3 inPosition;
@@ -28,13 +36,21 @@ layout(location = 3) out vec3 fragCameraPos;
 
 void main() {
     vec4 worldPosition = ubo.model * vec4(inPosition, 1.0);
+
+#ifdef MULTIVIEW
+    // View 0 is the refraction, view 1 the reflection
+    bool invert = gl_ViewIndex == 1;
+    gl_ClipDistance[0] = dot(worldPosition, invert ? pushConsts.reflectionPlane : pushConsts.clipPlane);
+#else
+    bool invert = pushConsts.invert.x > 0.5;
     gl_ClipDistance[0] = dot(worldPosition, pushConsts.clipPlane);
+#endif
 
-    if (pushConsts.invert.x > 0.5) {
+    if (invert) {
         gl_Position = ubo.proj * ubo.invertView * worldPosition;
     } else gl_Position = ubo.proj * ubo.view * worldPosition;
 
-    fragNormals = mat3(transpose(inverse(ubo.model))) * inNormals;
+    fragNormals = mat3(ubo.normalMatrix) * inNormals;
     fragTexCoord = inTexCoord;
     fragPos = worldPosition.xyz;
     fragCameraPos = ubo.cameraPos.xyz;
@@ -1,12 +1,23 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+#ifdef MULTIVIEW
+// Both layers of the multiview pass, refraction then reflection
+layout(set = 0, binding = 1) uniform sampler2DArray scene;
+#else
 layout(set = 0, binding = 1) uniform sampler2D refract;
 layout(set = 1, binding = 0) uniform sampler2D reflect;
+#endif
+layout(set = 1, binding = 2) readonly buffer TileActivity {
+    uint activity[];
+};
+layout(set = 1, binding = 4) uniform sampler2D slopes;
 
 layout(location = 0) in vec4 beforeDistortion;
 layout(location = 1) in vec3 inCamera;
-layout(location = 2) in vec3 normal;
+layout(location = 2) in vec4 tile;
+layout(location = 3) in vec3 texCoord;
+layout(location = 4) flat in mat3 normalMatrix;
 
 layout(location = 0) out vec4 outColor;
 
@@ -17,11 +28,29 @@ vec2 projecticeTexturing(vec4 point) {
 void main() {
     vec2 before = projecticeTexturing(beforeDistortion);
     
+#ifdef MULTIVIEW
+    vec4 refractFrag = texture(scene, vec3(before, 0.0));
+    before.y *= -1;
+    vec4 reflectFrag = texture(scene, vec3(before, 1.0));
+#else
     vec4 refractFrag = texture(refract, before);
     before.y *= -1;
     vec4 reflectFrag = texture(reflect, before);
+#endif
+
+    // Per pixel normal from the same blend of the two newest states as the heights
+    vec4 slope = texture(slopes, texCoord.xy);
+    vec2 gradient = mix(slope.zw, slope.xy, texCoord.z);
+    vec3 normal = normalize(normalMatrix * vec3(-gradient.x, 1.0, -gradient.y));
 
     float refractiveFactor = clamp(dot(normalize(inCamera), normal), 0.0, 1.0);
     float reflectiveFactor = clamp(pow(refractiveFactor, 2.0), 0.0, 1.0);
     outColor = mix(refractFrag, reflectFrag, reflectiveFactor);
+
+    // Debug view of the tiles the sparse kernel still steps
+    if (tile.z > 0.0) {
+        ivec2 cell = clamp(ivec2(tile.xy), ivec2(0), ivec2(tile.zw) - 1);
+        if (activity[cell.y * int(tile.z) + cell.x] > 0u)
+            outColor = mix(outColor, vec4(1.0, 0.2, 0.1, 1.0), 0.4);
+    }
 }
@@ -8,26 +8,104 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 invertView;
     mat4 invertModel;
     vec4 cameraPos;
+    vec4 simulation;
+    // Camera in the grid's model space
+    vec4 gridCamera;
+    mat4 normalMatrix;
 } ubo;
 
+// Snapshots of the newest state and the one before, published by the compute queue for this frame.
+// Mipmapped for the clipmap, level n has the spacing of clipmap level n
 layout(set = 1, binding = 1) uniform sampler2D heightmap;
+layout(set = 1, binding = 3) uniform sampler2D previousHeightmap;
 
+#if defined(PROCEDURAL) || defined(CLIPMAP)
+// Vertices per side of the procedural grid, which is also the clipmap's finest spacing.
+// One instance per row of cells, drawn as a strip alternating between the row's two edges
+layout(push_constant) uniform GridConsts {
+    uint resolution;
+    uint cells;
+    uint levels;
+} grid;
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormals;
 layout(location = 2) in vec2 inTexCoord;
+#endif
 
 layout(location = 0) out vec4 beforeDistortion;
 layout(location = 1) out vec3 toCamera;
+// Position in sparse tiles and the tile count, zero when not tinting them
+layout(location = 2) out vec4 tile;
+// Grid position and the blend between the two states, for the slopes in quad.frag
+layout(location = 3) out vec3 texCoord;
+layout(location = 4) flat out mat3 normalMatrix;
+
+#ifdef CLIPMAP
+// Corner of a level in finest cells. Levels centre on the camera snapped to twice their
+// spacing, so each one's vertices sit on the grid of the level around it
+ivec2 clipmapOrigin(int level) {
+    int snap = 2 << level;
+    ivec2 centre = ivec2(round(ubo.gridCamera.xz * float(grid.resolution) / float(snap))) * snap;
+
+    return centre - ((int(grid.cells) / 2) << level);
+}
+#endif
 
 void main() {
+    float lod = 0.0;
+
+#if defined(CLIPMAP)
+    int cells = int(grid.cells);
+    int level = gl_InstanceIndex / cells;
+    int row = gl_InstanceIndex % cells;
+    ivec2 vertex = ivec2(gl_VertexIndex >> 1, row + (gl_VertexIndex & 1));
+    ivec2 origin = clipmapOrigin(level);
+
+    // The finer level covers a block of half the cells, rows crossing it fold the vertices
+    // inside onto its edges so the strip only makes degenerate triangles there
+    if (level > 0) {
+        ivec2 hole = (clipmapOrigin(level - 1) - origin) >> level;
+
+        if (row >= hole.y && row < hole.y + cells / 2 && vertex.x > hole.x && vertex.x < hole.x + cells / 2)
+            vertex = (vertex.x < hole.x + cells / 4) ? ivec2(hole.x, row + 1) : ivec2(hole.x + cells / 2, row);
+    }
+
+    vec2 camera = ubo.gridCamera.xz * float(grid.resolution);
+    vec2 cell = vec2(origin + (vertex << level));
+
+    // Geomorph over the outer eighth: odd vertices slide onto their even neighbours and
+    // the height blends into the next mip, so the edge matches the coarser level exactly.
+    // The outermost level has nothing to match
+    vec2 away = abs(cell - camera) / float(1 << level);
+    float morph = (level + 1 < int(grid.levels))
+        ? clamp((max(away.x, away.y) - float(cells * 3 / 8 - 1)) / float(cells / 8), 0.0, 1.0) : 0.0;
+
+    cell -= vec2(vertex & 1) * morph * float(1 << level);
+    lod = float(level) + morph;
+
+    // Cells past the lake collapse onto its border
+    vec2 inTexCoord = clamp(cell / float(grid.resolution), -0.5, 0.5) + 0.5;
+    vec3 position = vec3(inTexCoord.x - 0.5, 0.0, inTexCoord.y - 0.5);
+#elif defined(PROCEDURAL)
+    // Same layout as models/grid.obj: a unit square at y = 0, rows running from +z to -z
+    uvec2 cell = uvec2(gl_VertexIndex >> 1, gl_InstanceIndex + 1 - (gl_VertexIndex & 1));
+    vec2 inTexCoord = vec2(cell.x, grid.resolution - 1 - cell.y) / float(grid.resolution - 1);
+    vec3 position = vec3(inTexCoord.x - 0.5, 0.0, inTexCoord.y - 0.5);
+#else
     vec3 position = inPosition;
+#endif
 
     vec4 worldPosition = ubo.model * vec4(position, 1.0);
     beforeDistortion = ubo.proj * ubo.view * worldPosition;
 
-    position.y += texture(heightmap, inTexCoord /*+ ubo.cameraPos.w / 4*/).r;
+    // ubo.simulation.x is how far the clock got between the two states
+    position.y += mix(textureLod(previousHeightmap, inTexCoord, lod).r, textureLod(heightmap, inTexCoord /*+ ubo.cameraPos.w / 4*/, lod).r, ubo.simulation.x);
     worldPosition = ubo.model * vec4(position, 1.0);
     gl_Position = ubo.proj * ubo.view * worldPosition;
 
     toCamera = ubo.cameraPos.xyz - worldPosition.xyz;
+    texCoord = vec3(inTexCoord, ubo.simulation.x);
+    normalMatrix = mat3(ubo.normalMatrix);
+    tile = vec4(inTexCoord * ubo.simulation.zw, ubo.simulation.zw * ubo.simulation.y);
 }
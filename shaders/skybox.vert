@@ -1,4 +1,7 @@
 #version 450
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : enable
+#endif
 
 layout (location = 0) in vec3 inPos;
 layout(location = 1) in vec3 inNormals;
@@ -27,7 +30,14 @@ void main()
 	outUVW = inPos;
 	outUVW.x *= -1.0;
 
-    if (pushConsts.invert.x > 0.5) {
+#ifdef MULTIVIEW
+    // View 0 is the refraction, view 1 the reflection
+    bool invert = gl_ViewIndex == 1;
+#else
+    bool invert = pushConsts.invert.x > 0.5;
+#endif
+
+    if (invert) {
         gl_Position = ubo.proj * ubo.invertView * ubo.invertModel * vec4(inPos.xyz, 1.0);
     } else gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPos.xyz, 1.0);
 }
@@ -14,8 +14,10 @@
 
 #include <algorithm>
 #include <array>
+#include <cfloat>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
@@ -23,6 +25,7 @@
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "camera.h"
@@ -40,12 +43,136 @@
 #include "vertex.h"
 #include "descriptor.h"
 #include "compute.h"
+#include "cpusolver.h"
+#include "impulse.h"
+#include "ocean.h"
+#include "workgroup.h"
 
 const int WIDTH = 1440;
 const int HEIGHT = 900;
 
 const int MAX_FRAMES_IN_FLIGHT = 3;
 
+// Pipelines are added to Compute in this order
+enum SimulationKernel : uint32_t {
+    KERNEL_BASELINE,
+    KERNEL_TILED,
+    KERNEL_BLOCKED,
+    KERNEL_PACKED,
+    KERNEL_SHALLOW_WATER,
+    KERNEL_SPARSE,
+    KERNEL_OCEAN,
+    KERNEL_SUBGROUP,
+    KERNEL_HALF,
+};
+
+// Where the Quad's vertices come from
+enum WaterGrid : uint32_t {
+    GRID_MODEL,         // models/grid.obj
+    GRID_PROCEDURAL,    // built in quad.vert from the vertex index, a vertex per cell
+    GRID_CLIPMAP,       // built in quad.vert as rings around the camera, coarser further out
+};
+
+// Lists the tiles KERNEL_SPARSE steps, added right after the kernels
+const uint32_t COMPACT_PIPELINE = KERNEL_HALF + 1;
+// Turns the two newest states into the slopes quad.frag shades with
+const uint32_t NORMALS_PIPELINE = COMPACT_PIPELINE + 1;
+// Writes the frame's impulses into the newest state
+const uint32_t SPLAT_PIPELINE = NORMALS_PIPELINE + 1;
+// Drops procedural rain into curr before each step
+const uint32_t RAIN_PIPELINE = SPLAT_PIPELINE + 1;
+
+const SimulationKernel SIMULATION_KERNEL = KERNEL_TILED;
+
+// Only .r carries height, R16_SFLOAT and R32_SFLOAT use the matching shader variants
+// and RGBA16F the default ones. The packed kernel always keeps (curr, prev) in R16G16_SFLOAT
+// and the shallow water one (elevation, u, v, depth) in RGBA16F
+const VkFormat SIMULATION_FORMAT = VK_FORMAT_R16_SFLOAT;
+
+// Handed to the compute shaders as specialization constants
+const uint32_t SIMULATION_WIDTH = 1024;
+const uint32_t SIMULATION_HEIGHT = 1024;
+const uint32_t SIMULATION_GROUP_X = 16;
+const uint32_t SIMULATION_GROUP_Y = 16;
+const float SIMULATION_RELAX = 1.985f;
+
+// The sparse kernel stops stepping a workgroup sized tile once no cell in it
+// moved more than this for a whole turn of the ring
+const float SIMULATION_SPARSE_THRESHOLD = 0.001f;
+
+// Shallow water mode, metres and seconds. The heightmap shapes the sea floor
+// between SHALLOW_WATER_DEPTH and a tenth of it, keep
+// TIMESTEP * sqrt(GRAVITY * DEPTH) / SPACING below 0.7
+const float SHALLOW_WATER_DEPTH = 10.0f;
+const float SHALLOW_WATER_GRAVITY = 9.81f;
+const float SHALLOW_WATER_TIMESTEP = 0.05f;
+const float SHALLOW_WATER_SPACING = 1.0f;
+// Rain only ever adds water, while it rains the surface sinks back toward rest by this fraction per second
+const float SHALLOW_WATER_DRAIN = 0.05f;
+
+// Winning workgroup shapes of the stepping kernel, per device and driver
+const char* const WORKGROUP_CACHE = "workgroup.cache";
+// Dispatches timed per candidate shape, a multiple of every ring length and turn
+// so the ring ends where it started
+const uint32_t TUNING_DISPATCHES = 48;
+
+// The procedural grid has GRID_RESOLUTION vertices per side so a vertex sits on every cell,
+// the clipmap's finest level has that spacing too. Its CLIPMAP_LEVELS levels have
+// CLIPMAP_CELLS cells per side, a multiple of 8, and each covers twice the one inside it.
+// The triangle count stays the same however large the lake gets
+const WaterGrid WATER_GRID = GRID_CLIPMAP;
+const uint32_t GRID_RESOLUTION = SIMULATION_WIDTH;
+const uint32_t CLIPMAP_CELLS = 128;
+const uint32_t CLIPMAP_LEVELS = 6;
+
+// Draws refraction and reflection as two views of one multiview pass, into layers
+// 0 and 1 of one image array, wherever the device has multiview
+const bool MULTIVIEW_OFFSCREEN = true;
+
+// Refraction and reflection targets per side of the window, 1, 0.5 or 0.25. The water
+// distorts them anyway, half a side is a quarter of the fragments of both scene passes.
+// OFFSCREEN_BLUR runs a separable Gaussian over them before the water filters them up
+const float OFFSCREEN_SCALE = 0.5f;
+const bool OFFSCREEN_BLUR = false;
+
+// Solver steps per second of wall time, whatever the frame rate. The blocked kernel
+// covers BLOCKED_STEPS of them per dispatch and the shallow water one runs in real time
+const uint32_t BLOCKED_STEPS = 4;
+const float SIMULATION_RATE = (SIMULATION_KERNEL == KERNEL_SHALLOW_WATER) ? 1.0f / SHALLOW_WATER_TIMESTEP : 60.0f;
+
+// Most dispatches one frame catches up on, time beyond that is dropped so a hitch cannot snowball
+const uint32_t MAX_DISPATCHES_PER_FRAME = 4;
+
+// Rain mode, drops per dispatch over the whole grid and their radius in cells.
+// Shallow water gains water from them, the wave equation gets dents
+const float RAIN_DROPS = 2000.0f;
+const float RAIN_RADIUS = 3.0f;
+
+// Deep ocean mode, the FFT field repeats over the grid every OCEAN_SIZE cells
+const uint32_t OCEAN_SIZE = 256;
+const float OCEAN_LENGTH = 250.0f;
+const OceanSpectrum OCEAN_SPECTRUM = SPECTRUM_JONSWAP;
+
+// The blocked kernel writes two time levels, so its ring needs a fourth image,
+// the packed and shallow water ones only read curr and just ping-pong, the ocean reads no level at all
+const uint32_t SIMULATION_IMAGES = (SIMULATION_KERNEL == KERNEL_BLOCKED) ? 4
+    : (SIMULATION_KERNEL == KERNEL_PACKED || SIMULATION_KERNEL == KERNEL_SHALLOW_WATER || SIMULATION_KERNEL == KERNEL_OCEAN) ? 2 : 3;
+
+// GPU passes bracketed by timestamps, water and grid share the scene slot
+enum GpuPass : uint32_t {
+    PASS_COMPUTE,
+    PASS_REFRACTION,
+    PASS_REFLECTION,
+    PASS_SCENE,
+    PASS_IMGUI,
+    PASS_COUNT,
+};
+
+const std::array<const char*, PASS_COUNT> PASS_NAMES = {"Compute", "Refraction", "Reflection", "Scene", "ImGui"};
+
+// Frames of GPU timings kept for the overlay graphs
+const uint32_t TIMING_HISTORY = 120;
+
 #ifdef NDEBUG
     const bool enableValidationLayers = false;
 #else
@@ -59,10 +186,17 @@ struct UniformBufferObject {
     alignas(16) glm::mat4 invertView;
     alignas(16) glm::mat4 invertModel;
     alignas(16) glm::vec4 cameraPos;
+    alignas(16) glm::vec4 simulation;
+    alignas(16) glm::vec4 gridCamera;
+    // Inverse transpose of model, a mat4 so it keeps std140's layout
+    alignas(16) glm::mat4 normalMatrix;
 };
 
-struct UserSimulationInput {
-    alignas(16) glm::vec4 mouse;
+// Vertex stage push constants of the Quad's procedural pipelines
+struct GridConstants {
+    uint32_t resolution = GRID_RESOLUTION;
+    uint32_t cells = CLIPMAP_CELLS;
+    uint32_t levels = CLIPMAP_LEVELS;
 };
 
 struct PushConstants {
@@ -70,8 +204,13 @@ struct PushConstants {
     alignas(4) glm::vec3 lightSource = glm::vec3(0.0f, 6.0f, -3.0f);
     alignas(4) glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
     alignas(4) glm::vec3 invert = glm::vec3(0.0f);
+    // Reflection view's clip plane in the multiview pass, whose refraction view takes clipPlane
+    alignas(16) glm::vec4 reflectionPlane = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 };
 
+const glm::vec4 REFRACTION_PLANE = glm::vec4(0.0f, -1.0f, 0.0f, 1.0f + 2.0f);
+const glm::vec4 REFLECTION_PLANE = glm::vec4(0.0f, 1.0f, 0.0f, -1.0f + 0.1f);
+
 class Application {
 public:
     void run()
@@ -93,10 +232,40 @@ private:
     ImGuiImpl* imgui;
 
     Compute* comp;
+
+    // SIMULATION_CPU in the environment steps the wave equation on the CPU
+    // and only uploads the newest level, one staging region per swapchain image
+    CpuSolver* cpu = nullptr;
+    bool cpuSimulation = std::getenv("SIMULATION_CPU") != nullptr;
+    VkBuffer cpuStaging;
+    VkDeviceMemory cpuStagingMemory;
+    void* cpuMapped;
+
+    // Per tile activity and the indirect dispatch built from it, see simulation_compact.comp
+    VkBuffer tileActivity;
+    VkDeviceMemory tileActivityMemory;
+    VkBuffer tileList;
+    VkDeviceMemory tileListMemory;
+    // Tiles the last sparse step dispatched, copied back so a settled field can skip stepping
+    VkBuffer tileCount;
+    VkDeviceMemory tileCountMemory;
+    void* tileCountMapped;
+
+    // Impulses wait here until a frame steps, then go to that image's region of impulseBuffer
+    ImpulseQueue impulses;
+    VkBuffer impulseBuffer;
+    VkDeviceMemory impulseMemory;
+    void* impulseMapped;
+
+    // Only in KERNEL_OCEAN, transforms its spectrum before every dispatch
+    Ocean* ocean = nullptr;
+
     Render* water;
     Render* grid;
-    Render* refraction;
-    Render* reflection;
+    Render* refraction = nullptr;
+    Render* reflection = nullptr;
+    // Both of the above in one multiview pass, the two are null then
+    Render* offscreen = nullptr;
 
     size_t currentFrame = 0;
     float currentTime = 0.0f;
@@ -117,7 +286,9 @@ private:
     VkBuffer indexBuffer;
     VkDeviceMemory indexBufferMemory;
 
-    std::vector<VkSemaphore> computeFinishedSemaphores;
+    // Counts simulation submits, rendering waits for the value of its own frame
+    VkSemaphore simulationTimeline;
+    uint64_t simulationValue = 0;
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
     std::vector<VkFence> inFlightFences;
@@ -125,6 +296,20 @@ private:
 
     bool framebufferResized = false;
     bool gridMode = false;
+    bool tilesMode = false;
+    bool rainMode = false;
+    // Dispatches so far, seeds the rain and drives the ocean's clock
+    uint32_t simulationStep = 0;
+
+    // Workgroup shape of the stepping kernel, zero until tuned or read from WORKGROUP_CACHE
+    VkExtent2D simulationGroup = {0, 0};
+
+    // Simulation clock, deltaTime accumulates until it pays for whole dispatches
+    float simulationAccumulator = 0.0f;
+    float simulationAlpha = 1.0f;
+
+    std::array<std::array<float, TIMING_HISTORY>, PASS_COUNT> passTimes = {};
+    uint32_t timingOffset = 0;
 
     void initWindow()
     {
@@ -198,25 +383,35 @@ private:
             });
         desc->addLayout({
                 {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT},
-                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_VERTEX_BIT}
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_VERTEX_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT},
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_VERTEX_BIT},
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT}
             });
         desc->addLayout({
                 {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
                 {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
                 {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
-                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT} 
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
             });
 
         desc->addPipeLayout({0}, {{VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants)}});
-        desc->addPipeLayout({0, 1});
-        desc->addPipeLayout({2});
+        desc->addPipeLayout({0, 1}, {{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GridConstants)}});
+        desc->addPipeLayout({2}, {{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t)}});
 
         desc->addMesh("Skybox", {0}, "models/cube.obj", new CubeMap("textures/storforsen"));
         desc->addMesh("Chalet", {0}, "models/chalet.obj", new Texture("textures/chalet.jpg"), {4.3f, 1.8f, 4.8f}, {-PI / 2, 0.0f, 0.0f});
         desc->addMesh("Lake", {0}, "models/lake.obj", new Texture("textures/lake.png"));
         desc->addMesh("Football", {0}, "models/football.obj", new Texture("textures/football.png"), {-1.0f, -1.5f, 0.0f}, {0.3, PI, -PI / 12}, {0.7f, 0.7f, 0.7f});
-        desc->addMesh("Quad", {0, 1}, "models/grid.obj", nullptr, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {10.0f, 1.0f, 10.0f});
-        desc->addMesh("Simulation", {2});
+        if (WATER_GRID != GRID_MODEL)
+            desc->addMesh("Quad", {0, 1}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {10.0f, 1.0f, 10.0f});
+        else desc->addMesh("Quad", {0, 1}, "models/grid.obj", nullptr, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {10.0f, 1.0f, 10.0f});
+        desc->addMesh("Simulation", std::vector<uint32_t>(SIMULATION_IMAGES, 2));
         desc->allocate();
 
         create::vertexBuffer(vertices, vertexBuffer, vertexBufferMemory);
@@ -224,73 +419,502 @@ private:
 
         setupCompute();
         setupRender();
+        setupTimestamps();
 
         createUniformBuffers();
         bindUnisToDescriptorSets();
+        tuneSimulationGroup();
 
         recordSimulationCommandBuffers();
         recordWaterCommandBuffers();
         recordGridCommandBuffers();
-        recordRefractionCommandBuffers();
-        recordReflectionCommandBuffers();
+        recordOffscreenCommandBuffers();
 
         createSyncObjects();
     }
 
     void setupCompute() {
-        comp = new Compute("simulation", 3, 1024, 1024);
+        VkFormat wanted = (SIMULATION_KERNEL == KERNEL_PACKED) ? VK_FORMAT_R16G16_SFLOAT : SIMULATION_FORMAT;
+        if (SIMULATION_KERNEL != KERNEL_SHALLOW_WATER && !storable(wanted))
+            std::cout << "The simulation format cannot be a storage image here, keeping the state in rgba16f" << std::endl;
+
+        // A prerecorded batch for every dispatch count the clock can ask for, none included
+        comp = new Compute("simulation", SIMULATION_IMAGES, SIMULATION_WIDTH, SIMULATION_HEIGHT, simulationFormat(), 0, MAX_DISPATCHES_PER_FRAME + 1,
+                WATER_GRID == GRID_CLIPMAP);
+        comp->constants.relax = SIMULATION_RELAX;
+        comp->constants.steps = BLOCKED_STEPS;
+        comp->constants.gravity = SHALLOW_WATER_GRAVITY;
+        comp->constants.timestep = SHALLOW_WATER_TIMESTEP;
+        comp->constants.spacing = SHALLOW_WATER_SPACING;
+        comp->constants.drain = SHALLOW_WATER_DRAIN;
+        comp->constants.threshold = SIMULATION_SPARSE_THRESHOLD;
+        comp->constants.ring = SIMULATION_IMAGES;
+
+        uploadHeightmap();
+
+        setupTiles();
+        setupImpulses();
+
+        if (cpuSimulation)
+            setupCpuSimulation();
+
+        if (SIMULATION_KERNEL == KERNEL_OCEAN)
+            setupOcean();
+
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation"), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation_tiled"), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation_blocked"), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), (simulationFormat() == VK_FORMAT_R16G16_SFLOAT)
+                ? "shaders/simulation_packed.comp.spv" : "shaders/simulation_packed.rgba16f.comp.spv", SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), "shaders/simulation_swe.comp.spv", SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation_sparse"), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("ocean_height"), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        addOptionalKernel(KERNEL_SUBGROUP, "simulation_subgroup", hw::loc::device()->subgroupShuffle);
+        addOptionalKernel(KERNEL_HALF, "simulation_half", hw::loc::device()->shaderFloat16, 2);
+        comp->addPipeline(desc->pipeLayout(2), "shaders/simulation_compact.comp.spv", SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation_normals", simulationFormat()), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation_splat", simulationFormat()), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation_rain", simulationFormat()), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+    }
 
+    // Starting state in prev and curr of rotation 0, the rest of the ring is only made usable
+    void uploadHeightmap() {
         VkBuffer stagingBuffer;
         VkDeviceMemory stagingBufferMemory;
-        create::staging("textures/heightmap.jpg", stagingBuffer, stagingBufferMemory);
+        if (SIMULATION_KERNEL == KERNEL_SHALLOW_WATER) {
+            // Still water at rest, the heightmap only raises the floor
+            create::staging("textures/heightmap.jpg", comp->extent().width, comp->extent().height, comp->format(), stagingBuffer, stagingBufferMemory,
+                    glm::vec4(0.0f, 0.0f, 0.0f, -0.9f * SHALLOW_WATER_DEPTH), glm::vec4(0.0f, 0.0f, 0.0f, SHALLOW_WATER_DEPTH));
+        } else {
+            create::staging("textures/heightmap.jpg", comp->extent().width, comp->extent().height, comp->format(), stagingBuffer, stagingBufferMemory);
+        }
 
-        for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++) {
-            hw::loc::comp()->transitionImageLayout(comp->color(i, 0), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-            hw::loc::comp()->copyBufferToImage(stagingBuffer, comp->color(i, 0), comp->extent().width, comp->extent().height);
-            hw::loc::comp()->transitionImageLayout(comp->color(i, 0), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+        hw::loc::comp()->transitionImageLayout(comp->color(comp->prev(0)), comp->format(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        hw::loc::comp()->copyBufferToImage(stagingBuffer, comp->color(comp->prev(0)), comp->extent().width, comp->extent().height);
+        hw::loc::comp()->transitionImageLayout(comp->color(comp->prev(0)), comp->format(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
 
-            hw::loc::comp()->transitionImageLayout(comp->color(i, 1), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-            hw::loc::comp()->copyBufferToImage(stagingBuffer, comp->color(i, 1), comp->extent().width, comp->extent().height);
-            hw::loc::comp()->transitionImageLayout(comp->color(i, 1), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+        hw::loc::comp()->transitionImageLayout(comp->color(comp->curr(0)), comp->format(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        hw::loc::comp()->copyBufferToImage(stagingBuffer, comp->color(comp->curr(0)), comp->extent().width, comp->extent().height);
+        hw::loc::comp()->transitionImageLayout(comp->color(comp->curr(0)), comp->format(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
 
-            hw::loc::comp()->transitionImageLayout(comp->color(i, 2), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-        }
+        for (uint32_t j = 2; j < comp->size(); j++)
+            hw::loc::comp()->transitionImageLayout(comp->color(comp->prev(j)), comp->format(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
         hw::loc::device()->destroy(stagingBuffer);
         hw::loc::device()->free(stagingBufferMemory);
+    }
+
+    // Only rgba16f storage images are guaranteed, the rest needs the extended formats feature too
+    bool storable(VkFormat format) {
+        if (format == VK_FORMAT_R16G16B16A16_SFLOAT)
+            return true;
+        return hw::loc::device()->storageImageExtendedFormats
+            && hw::loc::device()->supports(format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+    }
+
+    // SIMULATION_FORMAT where the device can store it, the stepping kernels' variants follow it
+    VkFormat steppingFormat() {
+        return storable(SIMULATION_FORMAT) ? SIMULATION_FORMAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+    }
+
+    // Kernels that need a device feature, the baseline takes their slot where it is missing
+    void addOptionalKernel(SimulationKernel kernel, std::string_view name, bool supported, uint32_t cellsX=1) {
+        if (supported) {
+            comp->addPipeline(desc->pipeLayout(2), simulationShader(name), SIMULATION_GROUP_X, SIMULATION_GROUP_Y, cellsX);
+            return;
+        }
+
+        if (SIMULATION_KERNEL == kernel)
+            std::cout << name << " is not supported here, stepping with the baseline kernel" << std::endl;
+        comp->addPipeline(desc->pipeLayout(2), simulationShader("simulation"), SIMULATION_GROUP_X, SIMULATION_GROUP_Y);
+    }
+
+    VkFormat simulationFormat() {
+        if (SIMULATION_KERNEL == KERNEL_PACKED)
+            return storable(VK_FORMAT_R16G16_SFLOAT) ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+        if (SIMULATION_KERNEL == KERNEL_SHALLOW_WATER)
+            return VK_FORMAT_R16G16B16A16_SFLOAT;
+        return steppingFormat();
+    }
+
+    std::string simulationShader(std::string_view name) {
+        return simulationShader(name, steppingFormat());
+    }
+
+    // Variants built by recompile_shaders.sh for the formats other than rgba16f. The stepping
+    // kernels only come in SIMULATION_FORMAT's, normals, splat and rain follow any solver
+    std::string simulationShader(std::string_view name, VkFormat format) {
+        std::string path = "shaders/" + std::string(name);
+
+        switch (format) {
+            case VK_FORMAT_R16_SFLOAT: path += ".r16f"; break;
+            case VK_FORMAT_R32_SFLOAT: path += ".r32f"; break;
+            case VK_FORMAT_R16G16_SFLOAT: path += ".rg16f"; break;
+            default: break;
+        }
+
+        return path + ".comp.spv";
+    }
+
+    // The sparse kernel's tiles are its workgroups, the ocean's cost is in its FFT and the CPU
+    // path never dispatches a step, those keep SIMULATION_GROUP_X by SIMULATION_GROUP_Y
+    void tuneSimulationGroup() {
+        if (cpu || SIMULATION_KERNEL == KERNEL_SPARSE || SIMULATION_KERNEL == KERNEL_OCEAN)
+            return;
+
+        if (simulationGroup.width == 0) {
+            VkPhysicalDeviceProperties properties;
+            hw::loc::device()->get(properties);
+
+            WorkgroupCache cache(WORKGROUP_CACHE);
+            std::string key = WorkgroupCache::key(properties, "kernel" + std::to_string(SIMULATION_KERNEL) + ":format" + std::to_string(simulationFormat())
+                    + ":" + std::to_string(comp->extent().width) + "x" + std::to_string(comp->extent().height));
+
+            if (hw::loc::device()->timestampBits == 0) {
+                // Nothing to time with, keep the default shape and do not cache it
+                simulationGroup = {SIMULATION_GROUP_X, SIMULATION_GROUP_Y};
+            } else if (!cache.find(key, simulationGroup)) {
+                simulationGroup = timeSimulationGroups(properties.limits);
+                cache.store(key, simulationGroup);
+                std::cout << "Simulation workgroup tuned to " << simulationGroup.width << "x" << simulationGroup.height << std::endl;
+
+                // Timing stepped the live ring, a cached launch starts from the heightmap too
+                uploadHeightmap();
+            }
+        }
+
+        comp->regroup(SIMULATION_KERNEL, simulationGroup.width, simulationGroup.height);
+    }
+
+    // Bytes of the stepping kernel's shared tile at a workgroup shape, the halos as in the shaders
+    uint32_t simulationSharedMemory(VkExtent2D group) {
+        switch (SIMULATION_KERNEL) {
+            case KERNEL_TILED:
+            case KERNEL_PACKED:
+                return (group.width + 2) * (group.height + 2) * sizeof(float);
+            case KERNEL_BLOCKED:
+                return 2 * (group.width + 2 * BLOCKED_STEPS) * (group.height + 2 * BLOCKED_STEPS) * sizeof(float);
+            case KERNEL_SHALLOW_WATER:
+                return (group.width + 2) * (group.height + 2) * sizeof(glm::vec4);
+            default:
+                return 0;
+        }
+    }
+
+    // Rebuilds the stepping kernel for every candidate and keeps the shape with the fewest GPU nanoseconds
+    VkExtent2D timeSimulationGroups(const VkPhysicalDeviceLimits& limits) {
+        VkQueryPool queryPool;
+        VkQueryPoolCreateInfo queryInfo = {};
+        queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryInfo.queryCount = 2;
+        hw::loc::device()->create(queryInfo, queryPool);
+
+        Mesh* simulation = nullptr;
+        for (auto& mesh : desc->meshes)
+            if (mesh->tag == "Simulation")
+                simulation = mesh;
+
+        VkExtent2D winner = {SIMULATION_GROUP_X, SIMULATION_GROUP_Y};
+        double fastest = DBL_MAX;
+
+        for (auto& group : WORKGROUP_CANDIDATES) {
+            if (!workgroupFits(limits, group, simulationSharedMemory(group)))
+                continue;
+
+            comp->regroup(SIMULATION_KERNEL, group.width, group.height);
+
+            // The first run pays for pipeline and cache warm up
+            double ns = 0.0;
+            for (uint32_t run = 0; run < 2; run++) {
+                hw::loc::comp()->customSingleCommand([&](VkCommandBuffer buffer) {
+                    vkCmdResetQueryPool(buffer, queryPool, 0, 2);
+                    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(SIMULATION_KERNEL));
+                    vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+                    for (uint32_t d = 0; d < TUNING_DISPATCHES; d++) {
+                        hw::loc::comp()->barrier(buffer,
+                                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+                        desc->bindDescriptor(buffer, simulation, 0, (d * simulationShift()) % comp->size(), 2, true);
+                        comp->dispatch(buffer, SIMULATION_KERNEL);
+                    }
+
+                    vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+                    return true;
+                });
 
-        comp->addPipeline(desc->pipeLayout(2), "shaders/simulation.comp.spv");
+                std::array<uint64_t, 2> ticks;
+                hw::loc::device()->get(queryPool, 0, 2, ticks.data());
+                ns = hw::loc::device()->elapsed(ticks[0], ticks[1]);
+            }
+
+            if (ns < fastest) {
+                fastest = ns;
+                winner = group;
+            }
+        }
+
+        hw::loc::device()->destroy(queryPool);
+        return winner;
+    }
+
+    uint32_t tilesX() {
+        return (comp->extent().width + SIMULATION_GROUP_X - 1) / SIMULATION_GROUP_X;
+    }
+
+    uint32_t tilesY() {
+        return (comp->extent().height + SIMULATION_GROUP_Y - 1) / SIMULATION_GROUP_Y;
+    }
+
+    // Always bound, every tile starts active and the dispatch is 1 deep and 1 high.
+    // The debug tint reads the per frame copy publish hands to the graphics queue
+    void setupTiles() {
+        VkDeviceSize tiles = static_cast<VkDeviceSize>(tilesX()) * tilesY() * sizeof(uint32_t);
+
+        create::buffer(tiles, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tileActivity, tileActivityMemory);
+        comp->shareBuffer(tileActivity, tiles);
+        create::buffer(tileListSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tileList, tileListMemory);
+
+        create::buffer(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, tileCount, tileCountMemory);
+        hw::loc::device()->map(tileCountMemory, sizeof(uint32_t), tileCountMapped);
+        *static_cast<uint32_t*>(tileCountMapped) = tilesX() * tilesY();
+
+        hw::loc::comp()->customSingleCommand([&](VkCommandBuffer buffer) {
+            vkCmdFillBuffer(buffer, tileActivity, 0, VK_WHOLE_SIZE, SIMULATION_IMAGES);
+            vkCmdFillBuffer(buffer, tileList, 0, VK_WHOLE_SIZE, 1);
+            return true;
+        });
+    }
+
+    // The sparse step of the newest finished submission listed no tile, and nothing
+    // lands on the water this frame. Stepping would only record empty dispatches then
+    bool simulationSettled() {
+        if (SIMULATION_KERNEL != KERNEL_SPARSE || cpu || ocean)
+            return false;
+        if (rainMode || camera->mousePressed || impulses.size() > 0)
+            return false;
+
+        uint64_t finished;
+        hw::loc::device()->get(simulationTimeline, finished);
+        return finished == simulationValue && *static_cast<uint32_t*>(tileCountMapped) == 0;
+    }
+
+    // Dispatch arguments padded to a uvec4, then one index per tile
+    VkDeviceSize tileListSize() {
+        return (4 + static_cast<VkDeviceSize>(tilesX()) * tilesY()) * sizeof(uint32_t);
+    }
+
+    // Host visible and mapped for good, a region per swapchain image that is free once its fence passed
+    void setupImpulses() {
+        VkDeviceSize size = impulseRegionSize() * hw::loc::swapChain()->size();
+
+        create::buffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, impulseBuffer, impulseMemory);
+        hw::loc::device()->map(impulseMemory, size, impulseMapped);
+
+        for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++)
+            impulseBatch(i) = ImpulseBatch();
+    }
+
+    VkDeviceSize impulseRegionSize() {
+        VkDeviceSize alignment = hw::loc::device()->storageAlignment;
+        return (sizeof(ImpulseBatch) + alignment - 1) / alignment * alignment;
+    }
+
+    ImpulseBatch& impulseBatch(uint32_t imageIndex) {
+        return *reinterpret_cast<ImpulseBatch*>(static_cast<char*>(impulseMapped) + imageIndex * impulseRegionSize());
+    }
+
+    void setupTimestamps() {
+        hw::loc::device()->createTimestamps(hw::loc::swapChain()->size(), PASS_COUNT, 1u << PASS_COMPUTE);
+        hw::loc::cmd()->customSingleCommand([](VkCommandBuffer buffer) {
+            hw::loc::device()->resetTimestamps(buffer);
+            return true;
+        });
+    }
+
+    // The image's fence has passed, so its last queries are final and reading never stalls
+    void readTimestamps(uint32_t imageIndex) {
+        std::vector<float> ms;
+        hw::loc::device()->timestamps(imageIndex, ms);
+
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+            passTimes[pass][timingOffset] = std::max(ms[pass], 0.0f);
+        timingOffset = (timingOffset + 1) % TIMING_HISTORY;
+    }
+
+    // One clock per swapchain image, the field itself is shared since compute submits run in order
+    void setupOcean() {
+        OceanSettings settings;
+        settings.size = OCEAN_SIZE;
+        settings.length = OCEAN_LENGTH;
+        settings.spectrum = OCEAN_SPECTRUM;
+
+        ocean = new Ocean(settings, hw::loc::swapChain()->size());
+    }
+
+    void setupCpuSimulation() {
+        if (SIMULATION_KERNEL == KERNEL_SHALLOW_WATER || SIMULATION_KERNEL == KERNEL_OCEAN)
+            throw std::runtime_error("the CPU solver only covers the wave equation!");
+
+        cpu = new CpuSolver(comp->extent().width, comp->extent().height, SIMULATION_RELAX);
+        cpu->reset(create::heightmap("textures/heightmap.jpg", comp->extent().width, comp->extent().height));
+
+        VkDeviceSize size = 2 * cpuStagingSize() * hw::loc::swapChain()->size();
+        create::buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cpuStaging, cpuStagingMemory);
+        hw::loc::device()->map(cpuStagingMemory, size, cpuMapped);
+
+        std::cout << "Simulating on the CPU (" << cpu->isa() << ")" << std::endl;
+    }
+
+    // One level, each swapchain image has the newest and the one before it
+    VkDeviceSize cpuStagingSize() {
+        return static_cast<VkDeviceSize>(comp->extent().width) * comp->extent().height * create::texelSize(comp->format());
+    }
+
+    // Impulses only leave the queue on frames that step, they land right after the first step.
+    // Region imageIndex is free again once the fence for that image was waited on
+    void feedSimulation(uint32_t imageIndex, uint32_t dispatches) {
+        if (dispatches == 0)
+            return;
+
+        if (camera->mousePressed) {
+            Impulse mouse;
+            mouse.x = camera->mousePosition.x;
+            mouse.y = camera->mousePosition.y;
+            mouse.amplitude = (SIMULATION_KERNEL == KERNEL_SHALLOW_WATER) ? -0.5f : -2.0f;
+            impulses.push(mouse);
+        }
+
+        // Rain is generated on the GPU only, the CPU solver stays dry
+        if (cpu) {
+            stepCpuSimulation(imageIndex, dispatches);
+            return;
+        }
+
+        // The ocean is driven by its clock alone, impulses and rain would only be overwritten
+        if (ocean) {
+            ocean->clock(imageIndex, simulationStep * simulationTick(), simulationTick());
+            impulses.drain(impulseBatch(imageIndex));
+            simulationStep += dispatches;
+            return;
+        }
+
+        ImpulseBatch& batch = impulseBatch(imageIndex);
+        impulses.drain(batch);
+
+        batch.rainCommand = {rainMode ? tilesX() : 0, tilesY(), 1, 0};
+        batch.rain.step = simulationStep;
+        batch.rain.rate = std::min(RAIN_DROPS / (tilesX() * tilesY()), 1.0f);
+        batch.rain.radius = std::min(RAIN_RADIUS, static_cast<float>(std::min(SIMULATION_GROUP_X, SIMULATION_GROUP_Y)));
+        batch.rain.amplitude = (SIMULATION_KERNEL == KERNEL_SHALLOW_WATER) ? 0.05f : -0.5f;
+        simulationStep += dispatches;
+    }
+
+    void stepCpuSimulation(uint32_t imageIndex, uint32_t dispatches) {
+        ImpulseBatch batch;
+        impulses.drain(batch);
+
+        for (uint32_t i = 0; i < dispatches; i++) {
+            cpu->step();
+
+            if (i == 0)
+                for (uint32_t j = 0; j < batch.command[0]; j++)
+                    cpu->splat(batch.impulses[j]);
+        }
+
+        char* region = static_cast<char*>(cpuMapped) + 2 * imageIndex * cpuStagingSize();
+        create::texels(cpu->state(), comp->format(), region);
+        create::texels(cpu->previous(), comp->format(), region + cpuStagingSize());
+    }
+
+    // Wall time one dispatch stands for
+    float simulationTick() {
+        return ((SIMULATION_KERNEL == KERNEL_BLOCKED) ? BLOCKED_STEPS : 1) / SIMULATION_RATE;
+    }
+
+    // Dispatches owed for the time since the last frame, what is left over
+    // becomes the blend between the last two states
+    uint32_t simulationDispatches() {
+        simulationAccumulator += deltaTime;
+
+        uint32_t dispatches = std::min(static_cast<uint32_t>(simulationAccumulator / simulationTick()), MAX_DISPATCHES_PER_FRAME);
+        simulationAccumulator = std::min(simulationAccumulator - dispatches * simulationTick(), simulationTick());
+        simulationAlpha = simulationAccumulator / simulationTick();
+
+        return dispatches;
+    }
+
+    // How far the image ring turns per dispatch and per frame
+    uint32_t simulationShift() {
+        return (SIMULATION_KERNEL == KERNEL_BLOCKED && !cpu) ? 2 : 1;
+    }
+
+    // The CPU path uploads only its newest level, however many steps it took
+    uint32_t simulationFrameShift(uint32_t dispatches) {
+        if (cpu)
+            return std::min(dispatches, 1u);
+        return dispatches * simulationShift();
+    }
+
+    // Every Render in use
+    std::vector<Render*> renders() {
+        if (offscreen)
+            return {water, grid, offscreen};
+        return {water, grid, refraction, reflection};
     }
 
     void setupRender() {
         water = new Render("water");
         grid = new Render("grid");
-        refraction = new Render("refraction", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-        reflection = new Render("refraction", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
         water->setToDefaultFBO();
         grid->setToDefaultFBO();
-        reflection->initFBO();
-        refraction->initFBO();
+
+        if (MULTIVIEW_OFFSCREEN && hw::loc::device()->multiview) {
+            offscreen = new Render("offscreen", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 2);
+            offscreen->initScaledFBO(OFFSCREEN_SCALE);
+        } else {
+            refraction = new Render("refraction", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            reflection = new Render("refraction", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            reflection->initScaledFBO(OFFSCREEN_SCALE);
+            refraction->initScaledFBO(OFFSCREEN_SCALE);
+        }
+
+        if (OFFSCREEN_BLUR)
+            for (auto& render: renders())
+                if (render != water && render != grid)
+                    render->addBlur();
 
         #pragma omp parallel for
-        for (auto& render: {water, grid, refraction, reflection}) {
-            render->addPipeline(desc->pipeLayout(0), "shaders/base.vert.spv", "shaders/base.frag.spv");
-            render->addPipeline(desc->pipeLayout(0), "shaders/skybox.vert.spv", "shaders/skybox.frag.spv", false);
-            render->addPipeline(desc->pipeLayout(0), "shaders/lighting.vert.spv", "shaders/lighting.frag.spv");
+        for (auto& render: renders()) {
+            std::string view = (render->viewCount() > 1) ? "multiview." : "";
+
+            render->addPipeline(desc->pipeLayout(0), "shaders/base." + view + "vert.spv", "shaders/base.frag.spv");
+            render->addPipeline(desc->pipeLayout(0), "shaders/skybox." + view + "vert.spv", "shaders/skybox.frag.spv", false);
+            render->addPipeline(desc->pipeLayout(0), "shaders/lighting." + view + "vert.spv", "shaders/lighting.frag.spv");
+
+            const std::array<const char*, 3> quadShaders = {"shaders/quad.vert.spv", "shaders/quad.procedural.vert.spv", "shaders/quad.clipmap.vert.spv"};
+            const char* quadFragment = offscreen ? "shaders/quad.multiview.frag.spv" : "shaders/quad.frag.spv";
+            bool procedural = WATER_GRID != GRID_MODEL;
 
             if (render->tag == "water") {
-                render->addPipeline(desc->pipeLayout(1), "shaders/quad.vert.spv", "shaders/quad.geom.spv", "shaders/quad.frag.spv", true, false);
+                render->addPipeline(desc->pipeLayout(1), quadShaders[WATER_GRID], quadFragment, true, false, procedural);
             }
             if (render->tag == "grid") {
-                render->addPipeline(desc->pipeLayout(1), "shaders/quad.vert.spv", "shaders/quad.geom.spv", "shaders/quad.frag.spv", true, true);
+                render->addPipeline(desc->pipeLayout(1), quadShaders[WATER_GRID], quadFragment, true, true, procedural);
             }
         }
     }
 
     void createSyncObjects()
     {
-        computeFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
@@ -305,11 +929,18 @@ private:
 
         #pragma omp parallel for
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            hw::loc::device()->create(semaphoreInfo, computeFinishedSemaphores[i]);
             hw::loc::device()->create(semaphoreInfo, imageAvailableSemaphores[i]);
             hw::loc::device()->create(semaphoreInfo, renderFinishedSemaphores[i]);
             hw::loc::device()->create(fenceInfo, inFlightFences[i]);
         }
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        timelineInfo.initialValue = simulationValue;
+
+        semaphoreInfo.pNext = &timelineInfo;
+        hw::loc::device()->create(semaphoreInfo, simulationTimeline);
     }
 
     void mainLoop()
@@ -332,11 +963,36 @@ private:
 
     void cleanupSwapChain()
     {
-        for (auto& render: {water, grid, refraction, reflection}) {
+        for (auto& render: renders()) {
             delete render;
         }
         delete comp;
 
+        hw::loc::device()->destroy(tileActivity);
+        hw::loc::device()->free(tileActivityMemory);
+        hw::loc::device()->destroy(tileList);
+        hw::loc::device()->free(tileListMemory);
+        hw::loc::device()->unmap(tileCountMemory);
+        hw::loc::device()->destroy(tileCount);
+        hw::loc::device()->free(tileCountMemory);
+
+        hw::loc::device()->unmap(impulseMemory);
+        hw::loc::device()->destroy(impulseBuffer);
+        hw::loc::device()->free(impulseMemory);
+
+        if (ocean) {
+            delete ocean;
+            ocean = nullptr;
+        }
+
+        if (cpu) {
+            hw::loc::device()->unmap(cpuStagingMemory);
+            hw::loc::device()->destroy(cpuStaging);
+            hw::loc::device()->free(cpuStagingMemory);
+            delete cpu;
+            cpu = nullptr;
+        }
+
     #ifdef IMGUI_ON
         imgui->cleanup();
     #endif
@@ -360,9 +1016,9 @@ private:
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             hw::loc::device()->destroy(renderFinishedSemaphores[i]);
             hw::loc::device()->destroy(imageAvailableSemaphores[i]);
-            hw::loc::device()->destroy(computeFinishedSemaphores[i]);
             hw::loc::device()->destroy(inFlightFences[i]);
         }
+        hw::loc::device()->destroy(simulationTimeline);
 
     #ifdef IMGUI_ON
         delete imgui;
@@ -396,10 +1052,12 @@ private:
 
         setupCompute();
         setupRender();
+        setupTimestamps();
         desc->allocate();
 
         createUniformBuffers();
         bindUnisToDescriptorSets();
+        tuneSimulationGroup();
 
     #ifdef IMGUI_ON
         imgui->adjust();
@@ -408,8 +1066,7 @@ private:
         recordSimulationCommandBuffers();
         recordWaterCommandBuffers();
         recordGridCommandBuffers();
-        recordRefractionCommandBuffers();
-        recordReflectionCommandBuffers();
+        recordOffscreenCommandBuffers();
     }
 
     void createUniformBuffers()
@@ -419,11 +1076,9 @@ private:
         #pragma omp parallel for
         for (auto& mesh : desc->meshes) {
             for (size_t i = 0; i < hw::loc::swapChain()->size(); i++) {
-                if (mesh->tag == "Simulation") {
-                    create::buffer(sizeof(UserSimulationInput), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, desc->getUniBuffer(mesh, i, 0), desc->getUniMemory(mesh, i, 0));
+                // Its input comes through impulseBuffer
+                if (mesh->tag == "Simulation")
                     continue;
-                }
 
                 create::buffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, desc->getUniBuffer(mesh, i, 0), desc->getUniMemory(mesh, i, 0));
@@ -444,10 +1099,21 @@ private:
             VkDescriptorImageInfo imageInfo2 = {};
             imageInfo2.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            VkDescriptorImageInfo imageInfo3 = {};
-            imageInfo3.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            VkDescriptorImageInfo heightmapInfo = {};
+            heightmapInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkDescriptorImageInfo previousHeightmapInfo = {};
+            previousHeightmapInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkDescriptorImageInfo slopesInfo = {};
+            slopesInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkDescriptorBufferInfo tileInfo = {};
+            tileInfo.buffer = comp->sharedBuffer(i);
+            tileInfo.offset = 0;
+            tileInfo.range = VK_WHOLE_SIZE;
 
-            std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
+            std::array<VkWriteDescriptorSet, 7> descriptorWrites = {};
             descriptorWrites[0] = desc->writeSet(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0);
             descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -458,7 +1124,16 @@ private:
             descriptorWrites[2].pImageInfo = &imageInfo2;
 
             descriptorWrites[3] = desc->writeSet(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
-            descriptorWrites[3].pImageInfo = &imageInfo3;
+            descriptorWrites[3].pImageInfo = &heightmapInfo;
+
+            descriptorWrites[4] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2);
+            descriptorWrites[4].pBufferInfo = &tileInfo;
+
+            descriptorWrites[5] = desc->writeSet(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3);
+            descriptorWrites[5].pImageInfo = &previousHeightmapInfo;
+
+            descriptorWrites[6] = desc->writeSet(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4);
+            descriptorWrites[6].pImageInfo = &slopesInfo;
 
             VkDescriptorImageInfo computeImageInfo = {};
             computeImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
@@ -469,11 +1144,34 @@ private:
             VkDescriptorImageInfo computeImageInfo2 = {};
             computeImageInfo2.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-            VkDescriptorBufferInfo computeBuffer = {};
-            computeBuffer.offset = 0;
-            computeBuffer.range = sizeof(UserSimulationInput);
+            VkDescriptorBufferInfo impulseInfo = {};
+            impulseInfo.buffer = impulseBuffer;
+            impulseInfo.offset = i * impulseRegionSize();
+            impulseInfo.range = sizeof(ImpulseBatch);
 
-            std::array<VkWriteDescriptorSet, 4> computeWrites = {};
+            VkDescriptorImageInfo computeImageInfo3 = {};
+            computeImageInfo3.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkDescriptorBufferInfo computeTileInfo = {};
+            computeTileInfo.buffer = tileActivity;
+            computeTileInfo.offset = 0;
+            computeTileInfo.range = VK_WHOLE_SIZE;
+
+            VkDescriptorBufferInfo tileListInfo = {};
+            tileListInfo.buffer = tileList;
+            tileListInfo.offset = 0;
+            tileListInfo.range = VK_WHOLE_SIZE;
+
+            VkDescriptorImageInfo computeSlopesInfo = {};
+            computeSlopesInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            computeSlopesInfo.imageView = comp->slopesView(i);
+
+            VkDescriptorImageInfo oceanInfo = {};
+            oceanInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            if (ocean)
+                oceanInfo.imageView = ocean->fieldView();
+
+            std::array<VkWriteDescriptorSet, 9> computeWrites = {};
             computeWrites[0] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0);
             computeWrites[0].pImageInfo = &computeImageInfo;
 
@@ -483,29 +1181,56 @@ private:
             computeWrites[2] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2);
             computeWrites[2].pImageInfo = &computeImageInfo2;
 
-            computeWrites[3] = desc->writeSet(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3);
-            computeWrites[3].pBufferInfo = &computeBuffer;
-            
-            #pragma omp parallel for
-            for (auto& mesh : desc->meshes) {
-                if (mesh->tag == "Simulation") {
-                    computeWrites[0].dstSet = desc->getDescriptor(mesh, i, 0);
-                    computeWrites[1].dstSet = desc->getDescriptor(mesh, i, 0);
-                    computeWrites[2].dstSet = desc->getDescriptor(mesh, i, 0);
-                    computeWrites[3].dstSet = desc->getDescriptor(mesh, i, 0);
+            computeWrites[3] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3);
+            computeWrites[3].pBufferInfo = &impulseInfo;
+
+            computeWrites[4] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4);
+            computeWrites[4].pImageInfo = &computeImageInfo3;
 
-                    computeImageInfo.imageView = comp->colorView(0, 0);
-                    computeImageInfo.sampler = comp->colorSampler(0, 0);
+            computeWrites[5] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5);
+            computeWrites[5].pBufferInfo = &computeTileInfo;
 
-                    computeImageInfo1.imageView = comp->colorView(0, 1);
-                    computeImageInfo1.sampler = comp->colorSampler(0, 1);
+            computeWrites[6] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6);
+            computeWrites[6].pBufferInfo = &tileListInfo;
 
-                    computeImageInfo2.imageView = comp->colorView(0, 2);
-                    computeImageInfo2.sampler = comp->colorSampler(0, 2);
+            computeWrites[7] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 7);
+            computeWrites[7].pImageInfo = &computeSlopesInfo;
 
-                    computeBuffer.buffer = desc->getUniBuffer(mesh, i, 0);
+            // Only ocean_height.comp reads the field, the other modes leave it unwritten
+            computeWrites[8] = desc->writeSet(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 8);
+            computeWrites[8].pImageInfo = &oceanInfo;
+            uint32_t computeWriteCount = ocean ? 9 : 8;
 
-                    hw::loc::device()->update(static_cast<uint32_t>(4), computeWrites.data());
+            for (auto& mesh : desc->meshes) {
+                if (mesh->tag == "Simulation") {
+                    // One set per rotation, so stepping never has to copy images
+                    for (uint32_t r = 0; r < comp->size(); r++) {
+                        computeWrites[0].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[1].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[2].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[3].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[4].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[5].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[6].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[7].dstSet = desc->getDescriptor(mesh, i, r);
+                        computeWrites[8].dstSet = desc->getDescriptor(mesh, i, r);
+
+                        computeImageInfo.imageView = comp->colorView(comp->prev(r));
+                        computeImageInfo.sampler = comp->colorSampler(comp->prev(r));
+
+                        computeImageInfo1.imageView = comp->colorView(comp->curr(r));
+                        computeImageInfo1.sampler = comp->colorSampler(comp->curr(r));
+
+                        computeImageInfo2.imageView = comp->colorView(comp->next(r));
+                        computeImageInfo2.sampler = comp->colorSampler(comp->next(r));
+
+                        computeImageInfo3.imageView = comp->colorView(comp->after(r));
+                        computeImageInfo3.sampler = comp->colorSampler(comp->after(r));
+
+                        computeBuffer.buffer = desc->getUniBuffer(mesh, i, 0);
+
+                        hw::loc::device()->update(computeWriteCount, computeWrites.data());
+                    }
                     continue;
                 }
 
@@ -517,17 +1242,31 @@ private:
                 if (mesh->tag == "Quad") {
                     descriptorWrites[2].dstSet = desc->getDescriptor(mesh, i, 1);
                     descriptorWrites[3].dstSet = desc->getDescriptor(mesh, i, 1);
+                    descriptorWrites[4].dstSet = desc->getDescriptor(mesh, i, 1);
+                    descriptorWrites[5].dstSet = desc->getDescriptor(mesh, i, 1);
+                    descriptorWrites[6].dstSet = desc->getDescriptor(mesh, i, 1);
+
+                    // The multiview layers go in the refraction slot, the reflection one is left unread
+                    Render* refracted = offscreen ? offscreen : refraction;
+                    Render* reflected = offscreen ? offscreen : reflection;
+
+                    imageInfo.imageView = refracted->colorView(i);
+                    imageInfo.sampler = refracted->colorSampler(i);
 
-                    imageInfo.imageView = refraction->colorView(i);
-                    imageInfo.sampler = refraction->colorSampler(i);
+                    imageInfo2.imageView = reflected->colorView(i);
+                    imageInfo2.sampler = reflected->colorSampler(i);
 
-                    imageInfo2.imageView = reflection->colorView(i);
-                    imageInfo2.sampler = reflection->colorSampler(i);
+                    // The frame's own snapshot, the state ring never leaves the compute queue
+                    heightmapInfo.imageView = comp->snapshotView(i, 0);
+                    heightmapInfo.sampler = comp->snapshotSampler(i, 0);
 
-                    imageInfo3.imageView = comp->colorView(0, 2);
-                    imageInfo3.sampler = comp->colorSampler(0, 2);
+                    previousHeightmapInfo.imageView = comp->snapshotView(i, 1);
+                    previousHeightmapInfo.sampler = comp->snapshotSampler(i, 1);
 
-                    hw::loc::device()->update(static_cast<uint32_t>(4), descriptorWrites.data());
+                    slopesInfo.imageView = comp->slopesView(i);
+                    slopesInfo.sampler = comp->slopesSampler(i);
+
+                    hw::loc::device()->update(static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data());
                 } else {
                     imageInfo.imageView = mesh->texture->view();
                     imageInfo.sampler = mesh->texture->sampler();
@@ -537,109 +1276,179 @@ private:
         }
     }
 
+    // One buffer per frame, rotation and dispatch count, drawFrame picks the one the clock asks for
     void recordSimulationCommandBuffers() {
         for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++) {
-            hw::loc::comp()->startBuffer(comp->commandBuffer(i));
-
-            for (auto& mesh: desc->meshes) {
-                if (mesh->tag == "Simulation") {
-
-                    hw::loc::comp()->barrier(
-                            comp->commandBuffer(i), 
-                            0, VK_ACCESS_SHADER_READ_BIT, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
-                        );
-
-                    desc->bindDescriptors(comp->commandBuffer(i), mesh, i, 2, true);
-                    vkCmdBindPipeline(comp->commandBuffer(i), VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(0));
-                    vkCmdDispatch(comp->commandBuffer(i), comp->extent().width / 32, comp->extent().height / 32, 1);
-
-                    hw::loc::comp()->imageBarrier(
-                            comp->commandBuffer(i), comp->color(0, 1),
-                            VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
-                        );
-                    
-                    hw::loc::comp()->imageBarrier(
-                            comp->commandBuffer(i), comp->color(0, 0),
-                            VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-                        );
-
-                    VkImageCopy imageCopy =  {
-                                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {0, 0, 0},
-                                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {0, 0, 0},
-                                {comp->extent().width, comp->extent().height, 1}
-                        };
-
-                    vkCmdCopyImage(
-                            comp->commandBuffer(i),
-                            comp->color(0, 1), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                            comp->color(0, 0), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                            1, &imageCopy
-                        );
-
-                    hw::loc::comp()->imageBarrier(
-                            comp->commandBuffer(i), comp->color(0, 0),
-                            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL
-                        );
-
-                    hw::loc::comp()->imageBarrier(
-                            comp->commandBuffer(i), comp->color(0, 1),
-                            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-                        );
-                    
-                    hw::loc::comp()->imageBarrier(
-                            comp->commandBuffer(i), comp->color(0, 2),
-                            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
-                        );
-
-                    vkCmdCopyImage(
-                            comp->commandBuffer(i),
-                            comp->color(0, 2), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                            comp->color(0, 1), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                            1, &imageCopy
-                        );
-
-                    hw::loc::comp()->imageBarrier(
-                            comp->commandBuffer(i), comp->color(0, 1),
-                            VK_ACCESS_SHADER_READ_BIT, 0, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL
-                        );
-                    
-                    hw::loc::comp()->imageBarrier(
-                            comp->commandBuffer(i), comp->color(0, 2),
-                            VK_ACCESS_SHADER_READ_BIT, 0, 
-                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL
-                        );
+            for (uint32_t r = 0; r < comp->size(); r++) {
+                for (uint32_t n = 0; n <= MAX_DISPATCHES_PER_FRAME; n++) {
+                    VkCommandBuffer& buffer = comp->commandBuffer(i, r, n);
+
+                    hw::loc::comp()->startBuffer(buffer);
+                    hw::loc::device()->beginTimestamp(buffer, i, PASS_COMPUTE);
+
+                    if (cpu && n > 0) {
+                        // The newest CPU level lands where the GPU step would have written it, and the
+                        // one before it over curr, which is older than that after several steps
+                        hw::Command::copyBufferToImage(buffer, cpuStaging, 2 * i * cpuStagingSize(),
+                                comp->color(comp->next(r)), comp->extent().width, comp->extent().height, VK_IMAGE_LAYOUT_GENERAL);
+                        hw::Command::copyBufferToImage(buffer, cpuStaging, (2 * i + 1) * cpuStagingSize(),
+                                comp->color(comp->curr(r)), comp->extent().width, comp->extent().height, VK_IMAGE_LAYOUT_GENERAL);
+                    }
+
+                    uint32_t newest = comp->curr(r + simulationFrameShift(n));
+                    // Newest level of the tick before, a blocked dispatch leaves a sub-step in between
+                    uint32_t previous = comp->curr(r + simulationFrameShift(n) + comp->size() - simulationShift());
+
+                    for (auto& mesh: desc->meshes) {
+                        if (mesh->tag != "Simulation")
+                            continue;
+
+                        if (!cpu) {
+                            vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(SIMULATION_KERNEL));
+
+                            for (uint32_t d = 0; d < n; d++) {
+                                // The ocean has no memory, only the two levels rendering samples matter
+                                if (ocean && d + 2 < n)
+                                    continue;
+
+                                if (ocean) {
+                                    ocean->record(buffer, i, d);
+                                    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(SIMULATION_KERNEL));
+                                }
+
+                                // Previous step wrote what this one reads, and it or the last publish
+                                // read what this one overwrites
+                                hw::loc::comp()->barrier(
+                                        buffer, 
+                                        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, 
+                                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                                    );
+
+                                desc->bindDescriptor(buffer, mesh, i, (r + d * simulationShift()) % comp->size(), 2, true);
+                                if (!ocean)
+                                    recordRain(buffer, i, d);
+
+                                if (SIMULATION_KERNEL == KERNEL_SPARSE)
+                                    recordSparseStep(buffer);
+                                else comp->dispatch(buffer, SIMULATION_KERNEL);
+
+                                if (d == 0 && !ocean)
+                                    recordSplat(buffer, mesh, i, r);
+                            }
+
+                            if (SIMULATION_KERNEL == KERNEL_SPARSE && n > 0)
+                                recordTileCount(buffer);
+                        }
+
+                        // The rotation whose prev and curr are the two newest levels
+                        hw::loc::comp()->barrier(buffer,
+                                VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+                        comp->clearSlopes(buffer, i);
+
+                        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(NORMALS_PIPELINE));
+                        desc->bindDescriptor(buffer, mesh, i, (newest + comp->size() - 1) % comp->size(), 2, true);
+                        comp->dispatch(buffer, NORMALS_PIPELINE);
+                    }
+
+                    // Rendering samples its own copies, so the next step never waits for the draw
+                    comp->publish(buffer, i, newest, previous);
+
+                    hw::loc::device()->endTimestamp(buffer, i, PASS_COMPUTE);
+                    hw::loc::comp()->endBuffer(buffer);
                 }
             }
-
-            hw::loc::comp()->endBuffer(comp->commandBuffer(i));
         }
     }
 
+    // Adds the drops to curr of the bound set, an empty dispatch while it is dry
+    void recordRain(VkCommandBuffer& buffer, uint32_t frame, uint32_t dispatch) {
+        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(RAIN_PIPELINE));
+        vkCmdPushConstants(buffer, desc->pipeLayout(2), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &dispatch);
+        vkCmdDispatchIndirect(buffer, impulseBuffer, frame * impulseRegionSize() + offsetof(ImpulseBatch, rainCommand));
+
+        hw::loc::comp()->barrier(buffer,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(SIMULATION_KERNEL));
+    }
+
+    // Only as many workgroups as the frame has impulses, bound with the set whose next is the newest level
+    void recordSplat(VkCommandBuffer& buffer, Mesh* mesh, uint32_t frame, uint32_t rotation) {
+        hw::loc::comp()->barrier(buffer,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(SPLAT_PIPELINE));
+        desc->bindDescriptor(buffer, mesh, frame, (rotation + simulationShift() - 1) % comp->size(), 2, true);
+        vkCmdDispatchIndirect(buffer, impulseBuffer, frame * impulseRegionSize());
+
+        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(SIMULATION_KERNEL));
+    }
+
+    // Lists the tiles worth stepping, then steps only those. With every tile settled the list
+    // is empty, and once that reads back drawFrame stops recording steps until something lands
+    void recordSparseStep(VkCommandBuffer& buffer) {
+        // The previous step and tile count copy are done reading the list before it is cleared
+        hw::loc::comp()->barrier(buffer,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        vkCmdFillBuffer(buffer, tileList, 0, sizeof(uint32_t), 0);
+        hw::loc::comp()->barrier(buffer,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(COMPACT_PIPELINE));
+        vkCmdDispatch(buffer, (tilesX() + SIMULATION_GROUP_X - 1) / SIMULATION_GROUP_X, (tilesY() + SIMULATION_GROUP_Y - 1) / SIMULATION_GROUP_Y, 1);
+
+        hw::loc::comp()->barrier(buffer,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(KERNEL_SPARSE));
+        vkCmdDispatchIndirect(buffer, tileList, 0);
+    }
+
+    // Workgroups in the last sparse dispatch, for simulationSettled
+    void recordTileCount(VkCommandBuffer& buffer) {
+        hw::loc::comp()->barrier(buffer,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        VkBufferCopy region = {0, 0, sizeof(uint32_t)};
+        vkCmdCopyBuffer(buffer, tileList, tileCount, 1, &region);
+
+        hw::loc::comp()->barrier(buffer,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+    }
+
+    // One strip per row of cells, quad.vert places the vertices
+    void drawProceduralGrid(VkCommandBuffer& buffer)
+    {
+        GridConstants gridConstants;
+
+        vkCmdPushConstants(buffer, desc->pipeLayout(1), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GridConstants), &gridConstants);
+
+        if (WATER_GRID == GRID_CLIPMAP)
+            vkCmdDraw(buffer, 2 * (CLIPMAP_CELLS + 1), CLIPMAP_CELLS * CLIPMAP_LEVELS, 0, 0);
+        else vkCmdDraw(buffer, 2 * GRID_RESOLUTION, GRID_RESOLUTION - 1, 0, 0);
+    }
+
     void recordWaterCommandBuffers()
     {
         for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++) {
             hw::loc::cmd()->startBuffer(water->commandBuffer(i));
+            hw::loc::device()->beginTimestamp(water->commandBuffer(i), i, PASS_SCENE);
+            comp->acquire(water->commandBuffer(i), i);
+            comp->downsample(water->commandBuffer(i), i);
             water->startPass(i);
 
             VkDeviceSize offsets[] = { 0 };
 
             PushConstants pushConstants;
 
-            #pragma omp parallel for
             for (auto& mesh : desc->meshes) {
                 if (mesh->tag == "Simulation")
                     continue;
@@ -652,7 +1461,7 @@ private:
                     desc->bindDescriptors(water->commandBuffer(i), mesh, i, 1);
 
                 vkCmdBindVertexBuffers(water->commandBuffer(i), 0, 1, &vertexBuffer, offsets);
-                /* vkCmdBindIndexBuffer(water->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32); */
+                vkCmdBindIndexBuffer(water->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
                 if ((mesh->tag == "Chalet") || (mesh->tag == "Football"))
                     vkCmdBindPipeline(water->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, water->pipeline(0));
@@ -663,11 +1472,13 @@ private:
                 else
                     vkCmdBindPipeline(water->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, water->pipeline(2));
 
-                /* vkCmdDrawIndexed(water->commandBuffer(i), mesh->vertex.size, 1, 0, mesh->vertex.start, 0); */
-                vkCmdDraw(water->commandBuffer(i), mesh->vertex.size, 1, mesh->vertex.start, 0);
+                if (mesh->tag == "Quad" && WATER_GRID != GRID_MODEL)
+                    drawProceduralGrid(water->commandBuffer(i));
+                else vkCmdDrawIndexed(water->commandBuffer(i), mesh->index.size, 1, mesh->index.start, mesh->vertex.start, 0);
             }
 
             water->endPass(i);
+            hw::loc::device()->endTimestamp(water->commandBuffer(i), i, PASS_SCENE);
             hw::loc::cmd()->endBuffer(water->commandBuffer(i));
         }
     }
@@ -676,13 +1487,15 @@ private:
     {
         for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++) {
             hw::loc::cmd()->startBuffer(grid->commandBuffer(i));
+            hw::loc::device()->beginTimestamp(grid->commandBuffer(i), i, PASS_SCENE);
+            comp->acquire(grid->commandBuffer(i), i);
+            comp->downsample(grid->commandBuffer(i), i);
             grid->startPass(i);
 
             VkDeviceSize offsets[] = { 0 };
 
             PushConstants pushConstants;
 
-            #pragma omp parallel for
             for (auto& mesh : desc->meshes) {
                 if (mesh->tag == "Simulation")
                     continue;
@@ -695,7 +1508,7 @@ private:
                     desc->bindDescriptors(grid->commandBuffer(i), mesh, i, 1);
 
                 vkCmdBindVertexBuffers(grid->commandBuffer(i), 0, 1, &vertexBuffer, offsets);
-                /* vkCmdBindIndexBuffer(grid->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32); */
+                vkCmdBindIndexBuffer(grid->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
                 if ((mesh->tag == "Chalet") || (mesh->tag == "Football"))
                     vkCmdBindPipeline(grid->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, grid->pipeline(0));
@@ -706,27 +1519,82 @@ private:
                 else
                     vkCmdBindPipeline(grid->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, grid->pipeline(2));
 
-                /* vkCmdDrawIndexed(grid->commandBuffer(i), mesh->vertex.size, 1, 0, mesh->vertex.start, 0); */
-                vkCmdDraw(grid->commandBuffer(i), mesh->vertex.size, 1, mesh->vertex.start, 0);
+                if (mesh->tag == "Quad" && WATER_GRID != GRID_MODEL)
+                    drawProceduralGrid(grid->commandBuffer(i));
+                else vkCmdDrawIndexed(grid->commandBuffer(i), mesh->index.size, 1, mesh->index.start, mesh->vertex.start, 0);
             }
 
             grid->endPass(i);
+            hw::loc::device()->endTimestamp(grid->commandBuffer(i), i, PASS_SCENE);
             hw::loc::cmd()->endBuffer(grid->commandBuffer(i));
         }
     }
 
+    void recordOffscreenCommandBuffers()
+    {
+        if (offscreen)
+            recordMultiviewCommandBuffers();
+        else {
+            recordRefractionCommandBuffers();
+            recordReflectionCommandBuffers();
+        }
+    }
+
+    // Refraction and reflection in one walk over the scene, timed as the refraction pass
+    void recordMultiviewCommandBuffers()
+    {
+        for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++) {
+            hw::loc::cmd()->startBuffer(offscreen->commandBuffer(i));
+            hw::loc::device()->beginTimestamp(offscreen->commandBuffer(i), i, PASS_REFRACTION);
+            offscreen->startPass(i);
+
+            VkDeviceSize offsets[] = { 0 };
+
+            PushConstants pushConstants;
+            pushConstants.clipPlane = REFRACTION_PLANE;
+            pushConstants.reflectionPlane = REFLECTION_PLANE;
+
+            for (auto& mesh : desc->meshes) {
+                if (mesh->tag == "Simulation")
+                    continue;
+
+                if (mesh->tag == "Quad")
+                    continue;
+
+                vkCmdPushConstants(offscreen->commandBuffer(i), desc->pipeLayout(0), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
+
+                desc->bindDescriptors(offscreen->commandBuffer(i), mesh, i, 0);
+                vkCmdBindVertexBuffers(offscreen->commandBuffer(i), 0, 1, &vertexBuffer, offsets);
+                vkCmdBindIndexBuffer(offscreen->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+                if ((mesh->tag == "Chalet") || (mesh->tag == "Football"))
+                    vkCmdBindPipeline(offscreen->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, offscreen->pipeline(0));
+                else if (mesh->tag == "Skybox")
+                    vkCmdBindPipeline(offscreen->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, offscreen->pipeline(1));
+                else
+                    vkCmdBindPipeline(offscreen->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, offscreen->pipeline(2));
+
+                vkCmdDrawIndexed(offscreen->commandBuffer(i), mesh->index.size, 1, mesh->index.start, mesh->vertex.start, 0);
+            }
+
+            offscreen->endPass(i);
+            hw::loc::device()->endTimestamp(offscreen->commandBuffer(i), i, PASS_REFRACTION);
+            hw::loc::cmd()->endBuffer(offscreen->commandBuffer(i));
+        }
+    }
+
     void recordRefractionCommandBuffers()
     {
         for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++) {
             hw::loc::cmd()->startBuffer(refraction->commandBuffer(i));
+            hw::loc::device()->beginTimestamp(refraction->commandBuffer(i), i, PASS_REFRACTION);
             refraction->startPass(i);
 
             VkDeviceSize offsets[] = { 0 };
 
             PushConstants pushConstants;
-            pushConstants.clipPlane = glm::vec4(0.0f, -1.0f, 0.0f, 1.0f + 2.0f);
+            pushConstants.clipPlane = REFRACTION_PLANE;
 
-            #pragma omp parallel for
             for (auto& mesh : desc->meshes) {
                 if (mesh->tag == "Simulation")
                     continue;
@@ -738,7 +1606,7 @@ private:
 
                 desc->bindDescriptors(refraction->commandBuffer(i), mesh, i, 0);
                 vkCmdBindVertexBuffers(refraction->commandBuffer(i), 0, 1, &vertexBuffer, offsets);
-                /* vkCmdBindIndexBuffer(refraction->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32); */
+                vkCmdBindIndexBuffer(refraction->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
                 if ((mesh->tag == "Chalet") || (mesh->tag == "Football"))
                     vkCmdBindPipeline(refraction->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, refraction->pipeline(0));
@@ -747,11 +1615,11 @@ private:
                 else
                     vkCmdBindPipeline(refraction->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, refraction->pipeline(2));
 
-                /* vkCmdDrawIndexed(refraction->commandBuffer(i), mesh->vertex.size, 1, 0, mesh->vertex.start, 0); */
-                vkCmdDraw(refraction->commandBuffer(i), mesh->vertex.size, 1, mesh->vertex.start, 0);
+                vkCmdDrawIndexed(refraction->commandBuffer(i), mesh->index.size, 1, mesh->index.start, mesh->vertex.start, 0);
             }
 
             refraction->endPass(i);
+            hw::loc::device()->endTimestamp(refraction->commandBuffer(i), i, PASS_REFRACTION);
             hw::loc::cmd()->endBuffer(refraction->commandBuffer(i));
         }
     }
@@ -760,15 +1628,15 @@ private:
     {
         for (uint32_t i = 0; i < hw::loc::swapChain()->size(); i++) {
             hw::loc::cmd()->startBuffer(reflection->commandBuffer(i));
+            hw::loc::device()->beginTimestamp(reflection->commandBuffer(i), i, PASS_REFLECTION);
             reflection->startPass(i);
 
             VkDeviceSize offsets[] = { 0 };
 
             PushConstants pushConstants;
-            pushConstants.clipPlane = glm::vec4(0.0f, 1.0f, 0.0f, -1.0f + 0.1f);
+            pushConstants.clipPlane = REFLECTION_PLANE;
             pushConstants.invert = glm::vec3(1.0f);
 
-            #pragma omp parallel for
             for (auto& mesh : desc->meshes) {
                 if (mesh->tag == "Simulation")
                     continue;
@@ -780,7 +1648,7 @@ private:
 
                 desc->bindDescriptors(reflection->commandBuffer(i), mesh, i, 0);
                 vkCmdBindVertexBuffers(reflection->commandBuffer(i), 0, 1, &vertexBuffer, offsets);
-                /* vkCmdBindIndexBuffer(reflection->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32); */
+                vkCmdBindIndexBuffer(reflection->commandBuffer(i), indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
                 if (mesh->tag == "Chalet")
                     vkCmdBindPipeline(reflection->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, reflection->pipeline(0));
@@ -789,11 +1657,11 @@ private:
                 else
                     vkCmdBindPipeline(reflection->commandBuffer(i), VK_PIPELINE_BIND_POINT_GRAPHICS, reflection->pipeline(2));
 
-                /* vkCmdDrawIndexed(reflection->commandBuffer(i), mesh->vertex.size, 1, 0, mesh->vertex.start, 0); */
-                vkCmdDraw(reflection->commandBuffer(i), mesh->vertex.size, 1, mesh->vertex.start, 0);
+                vkCmdDrawIndexed(reflection->commandBuffer(i), mesh->index.size, 1, mesh->index.start, mesh->vertex.start, 0);
             }
 
             reflection->endPass(i);
+            hw::loc::device()->endTimestamp(reflection->commandBuffer(i), i, PASS_REFLECTION);
             hw::loc::cmd()->endBuffer(reflection->commandBuffer(i));
         }
     }
@@ -806,22 +1674,11 @@ private:
         ubo.view = camera->view;
         ubo.invertView = camera->viewI;
         ubo.cameraPos = glm::vec4(camera->cameraPos, currentTime);
+        ubo.simulation = glm::vec4(simulationAlpha, tilesMode ? 1.0f : 0.0f, tilesX(), tilesY());
 
-        #pragma omp parallel for
         for (auto& mesh : desc->meshes) {
-            if (mesh->tag == "Simulation") {
-                UserSimulationInput usi = {};
-                usi.mouse = glm::vec4(0.0f);
-                usi.mouse.z = (camera->mousePressed) ? 1.0f : 0.0f;
-                usi.mouse.x = camera->mousePosition.x;
-                usi.mouse.y = camera->mousePosition.y;
-
-                void* data;
-                hw::loc::device()->map(desc->getUniMemory(mesh, currentImage, 0), sizeof(usi), data);
-                memcpy(data, &usi, sizeof(usi));
-                hw::loc::device()->unmap(desc->getUniMemory(mesh, currentImage, 0));
+            if (mesh->tag == "Simulation")
                 continue;
-            }
 
             glm::mat4 position;
             glm::mat4 rotation = glm::mat4_cast(glm::normalize(glm::quat(mesh->rotation)));
@@ -839,6 +1696,9 @@ private:
             }
 
             ubo.model = position * rotation * scale * glm::mat4(1.0f);
+            ubo.normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(ubo.model))));
+            if (mesh->tag == "Quad")
+                ubo.gridCamera = glm::inverse(ubo.model) * glm::vec4(camera->cameraPos, 1.0f);
             if (mesh->tag == "Skybox")
                 ubo.invertModel = glm::translate(glm::mat4(1.0f), camera->cameraPos - camera->distance(camera->cameraPos)) * rotation * scale * glm::mat4(1.0f);
             else ubo.invertModel = ubo.model;
@@ -859,6 +1719,14 @@ private:
         ImGui::NewFrame();
         /* ImGui::Text("Clip Distance Change"); */
         /* ImGui::SliderFloat("Height", &clipPlane.w, -10.0f, 10.0f); */
+        ImGui::Begin("GPU timings");
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+            uint32_t newest = (timingOffset + TIMING_HISTORY - 1) % TIMING_HISTORY;
+            char overlay[32];
+            snprintf(overlay, sizeof(overlay), "%.3f ms", passTimes[pass][newest]);
+            ImGui::PlotLines(PASS_NAMES[pass], passTimes[pass].data(), TIMING_HISTORY, timingOffset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+        }
+        ImGui::End();
         ImGui::Render();
     #endif
 
@@ -877,52 +1745,84 @@ private:
             throw std::runtime_error("failed to acquire swap chain image!");
         }
 
+        uint32_t dispatches = simulationDispatches();
+        if (simulationSettled())
+            dispatches = 0;
+
         updateUniformBuffer(imageIndex);
         camera->processInput();
         if (camera->gridMode) {
             gridMode = !gridMode;
         }
+        if (camera->tilesMode && SIMULATION_KERNEL == KERNEL_SPARSE) {
+            tilesMode = !tilesMode;
+        }
+        if (camera->rainMode) {
+            rainMode = !rainMode;
+        }
 
         // Sync to GPU
         if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
             hw::loc::device()->waitFence(imagesInFlight[imageIndex]);
+            readTimestamps(imageIndex);
         }
         imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
     #ifdef IMGUI_ON
         // Render IMGUI
-        imgui->recordCommandBuffer(imageIndex);
+        imgui->recordCommandBuffer(imageIndex, PASS_IMGUI);
     #endif
 
-        // Submit
+        feedSimulation(imageIndex, dispatches);
+
+        // Submit. The step only waits for work the CPU already fenced, so on a dedicated
+        // compute queue it overlaps whatever the graphics queue is still drawing
         {
             std::vector<VkCommandBuffer> submitBuffers = {
-                comp->commandBuffer(imageIndex),
+                comp->commandBuffer(imageIndex, comp->current(), dispatches),
             };
 
-            VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
-            VkSemaphore signalSemaphores[] = { computeFinishedSemaphores[currentFrame] };
+            uint64_t signalValue = ++simulationValue;
+
+            VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &signalValue;
 
             VkSubmitInfo submitInfo = {};
             submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = waitSemaphores;
-            submitInfo.pWaitDstStageMask = waitStages;
+            submitInfo.pNext = &timelineInfo;
             submitInfo.commandBufferCount = static_cast<uint32_t>(submitBuffers.size());
             submitInfo.pCommandBuffers = submitBuffers.data();
             submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = signalSemaphores;
+            submitInfo.pSignalSemaphores = &simulationTimeline;
 
             hw::loc::device()->submitCompute(submitInfo, VK_NULL_HANDLE);
+            comp->advance(simulationFrameShift(dispatches));
+        }
+
+        // Offscreen passes need neither the swapchain image nor the water
+        {
+            std::vector<VkCommandBuffer> submitCommandBuffers;
+            if (offscreen)
+                submitCommandBuffers = {offscreen->commandBuffer(imageIndex)};
+            else submitCommandBuffers = {
+                refraction->commandBuffer(imageIndex),
+                reflection->commandBuffer(imageIndex),
+            };
+
+            VkSubmitInfo submitInfo = {};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = static_cast<uint32_t>(submitCommandBuffers.size());
+            submitInfo.pCommandBuffers = submitCommandBuffers.data();
+
+            hw::loc::device()->submitGraphics(submitInfo, VK_NULL_HANDLE);
         }
 
         {
             std::vector<VkCommandBuffer> submitCommandBuffers;
             if (gridMode)
                 submitCommandBuffers = {
-                    refraction->commandBuffer(imageIndex),
-                    reflection->commandBuffer(imageIndex),
                     grid->commandBuffer(imageIndex),
                 #ifdef IMGUI_ON
                     imgui->getCommandBuffer(imageIndex),
@@ -930,21 +1830,28 @@ private:
                 };
             else
                 submitCommandBuffers = {
-                    refraction->commandBuffer(imageIndex),
-                    reflection->commandBuffer(imageIndex),
                     water->commandBuffer(imageIndex),
                 #ifdef IMGUI_ON
                     imgui->getCommandBuffer(imageIndex),
                 #endif
                 };
 
-            VkSemaphore waitSemaphores[] = { computeFinishedSemaphores[currentFrame] };
-            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+            // The binary value is ignored, the timeline one is this frame's step
+            uint64_t waitValues[] = { 0, simulationValue };
+
+            VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.waitSemaphoreValueCount = 2;
+            timelineInfo.pWaitSemaphoreValues = waitValues;
+
+            VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], simulationTimeline };
+            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT };
             VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
 
             VkSubmitInfo submitInfo = {};
             submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pNext = &timelineInfo;
+            submitInfo.waitSemaphoreCount = 2;
             submitInfo.pWaitSemaphores = waitSemaphores;
             submitInfo.pWaitDstStageMask = waitStages;
             submitInfo.commandBufferCount = static_cast<uint32_t>(submitCommandBuffers.size());
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <volk.h>
+
+#include <array>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "locator.h"
+#include "instance.h"
+#include "device.h"
+#include "command.h"
+#include "json.h"
+
+// What sim_bench and ocean_bench share: a headless device, a timestamp pair around one compute
+// submit, --key value options and the device field of the JSON they print
+namespace bench {
+    // Overwrites the defaults in args, false on an option args doesn't already hold
+    inline bool parse(int argc, char** argv, std::map<std::string, std::string>& args) {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string key = argv[i];
+            if (key.rfind("--", 0) != 0 || !args.count(key.substr(2))) {
+                std::cerr << "unknown option " << key << std::endl;
+                return false;
+            }
+            args[key.substr(2)] = argv[i + 1];
+        }
+
+        return true;
+    }
+
+    // Provides the locator's instance, device and both command pools for its lifetime.
+    // Benches derive from it, so their own resources go before the device does
+    class Harness {
+        public:
+            Harness() {
+                hw::loc::provide(new hw::Instance(false, true));
+                hw::loc::provide(new hw::Device(false, true));
+                hw::loc::provide(new hw::Command(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT));
+                hw::loc::provide(new hw::Command(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, true), true);
+
+                if (hw::loc::device()->timestampBits == 0)
+                    throw std::runtime_error("compute queue cannot write timestamps!");
+
+                VkQueryPoolCreateInfo queryInfo = {};
+                queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+                queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+                queryInfo.queryCount = 2;
+                hw::loc::device()->create(queryInfo, queryPool);
+            }
+
+            virtual ~Harness() {
+                hw::loc::device()->waitDevice();
+
+                hw::loc::device()->destroy(queryPool);
+
+                delete hw::loc::comp();
+                delete hw::loc::cmd();
+                delete hw::loc::device();
+                delete hw::loc::instance();
+            }
+
+            // GPU nanoseconds of whatever record puts into buffer, submitted alone on the compute queue
+            double time(VkCommandBuffer& buffer, const std::function<void(VkCommandBuffer&)>& record) {
+                hw::loc::device()->reset(buffer);
+                hw::loc::comp()->startBuffer(buffer);
+
+                vkCmdResetQueryPool(buffer, queryPool, 0, 2);
+                vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+                record(buffer);
+
+                vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+                hw::loc::comp()->endBuffer(buffer);
+
+                VkSubmitInfo submitInfo = {};
+                submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &buffer;
+
+                hw::loc::device()->submitCompute(submitInfo, VK_NULL_HANDLE);
+                hw::loc::device()->waitCompute();
+
+                std::array<uint64_t, 2> ticks;
+                hw::loc::device()->get(queryPool, 0, 2, ticks.data());
+
+                return hw::loc::device()->elapsed(ticks[0], ticks[1]);
+            }
+
+            // Opens a result object with the device's name
+            std::string device() {
+                VkPhysicalDeviceProperties info;
+                vkGetPhysicalDeviceProperties(hw::loc::device()->getPhysical(), &info);
+
+                return "{\"device\": \"" + json::escape(info.deviceName) + "\", ";
+            }
+
+        private:
+            VkQueryPool queryPool;
+    };
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <volk.h>
+
+#include <array>
+#include <string_view>
+#include <vector>
+
+#include "locator.h"
+#include "device.h"
+#include "command.h"
+#include "create.h"
+#include "shader.h"
+
+// Separable Gaussian over a Render's color images, recorded right after its pass. Rows go
+// into a scratch image, columns into the output that view() and sampler() hand out instead
+// of the color image. Every layer of a multiview target is blurred in the same dispatches
+class Blur {
+    public:
+        static const uint32_t GROUP = 8;
+
+        // Same view type as the Render's own color view, the shaders sampling it don't change
+        VkImageView& view(uint32_t frame) {
+            return outputViews[frame];
+        }
+
+        VkSampler& sampler(uint32_t frame) {
+            return outputSamplers[frame];
+        }
+
+        // Waits for the pass that wrote the frame's color image and leaves the output
+        // ready for the fragment shaders. Leaves the blur's pipeline and set bound
+        void record(VkCommandBuffer& buffer, uint32_t frame) {
+            // Also waits out the compute reads of the scratch image from the frame before
+            hw::loc::cmd()->imageBarrier(buffer, sources[frame],
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, layers);
+
+            // The last contents were sampled by the water already, nothing to keep
+            hw::loc::cmd()->imageBarrier(buffer, outputs[frame],
+                    0, VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, layers);
+
+            vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+            std::array<float, 2> rows = {1.0f / extent.width, 0.0f};
+            vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &sets[2 * frame], 0, nullptr);
+            vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(rows), rows.data());
+            vkCmdDispatch(buffer, (extent.width + GROUP - 1) / GROUP, (extent.height + GROUP - 1) / GROUP, layers);
+
+            hw::loc::cmd()->barrier(buffer,
+                    VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+            std::array<float, 2> columns = {0.0f, 1.0f / extent.height};
+            vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &sets[2 * frame + 1], 0, nullptr);
+            vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(columns), columns.data());
+            vkCmdDispatch(buffer, (extent.width + GROUP - 1) / GROUP, (extent.height + GROUP - 1) / GROUP, layers);
+
+            hw::loc::cmd()->imageBarrier(buffer, outputs[frame],
+                    VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, layers);
+        }
+
+        // One source per frame, each with the given format, size and layer count
+        Blur(std::vector<VkImage>& _sources, VkFormat format, VkExtent2D _extent, uint32_t _layers=1)
+            : sources(_sources), extent(_extent), layers(_layers) {
+            initImages(format);
+            initDescriptors();
+
+            Shader shader("shaders/offscreen_blur.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+            VkComputePipelineCreateInfo pipelineInfo = {};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipelineInfo.layout = pipelineLayout;
+            pipelineInfo.stage = shader.info();
+            hw::loc::device()->create(pipelineInfo, pipeline);
+        }
+
+        ~Blur() {
+            hw::loc::device()->destroy(pipeline);
+            hw::loc::device()->destroy(pipelineLayout);
+            hw::loc::device()->destroy(pool);
+            hw::loc::device()->destroy(setLayout);
+
+            for (uint32_t i = 0; i < sources.size(); i++) {
+                hw::loc::device()->destroy(sourceViews[i]);
+
+                hw::loc::device()->destroy(scratchViews[i]);
+                hw::loc::device()->destroy(scratch[i]);
+                hw::loc::device()->free(scratchMemory[i]);
+
+                hw::loc::device()->destroy(outputViews[i]);
+                hw::loc::device()->destroy(outputStorageViews[i]);
+                hw::loc::device()->destroy(outputSamplers[i]);
+                hw::loc::device()->destroy(outputs[i]);
+                hw::loc::device()->free(outputMemory[i]);
+            }
+
+            hw::loc::device()->destroy(edgeSampler);
+        }
+
+    private:
+        // Half floats keep the dark end of the linear colours the sRGB targets hold
+        static constexpr VkFormat FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+        std::vector<VkImage> sources;
+        VkExtent2D extent;
+        uint32_t layers;
+
+        // Array views of the sources and the scratch, both read through edgeSampler
+        std::vector<VkImageView> sourceViews;
+        VkSampler edgeSampler;
+
+        std::vector<VkImage> scratch;
+        std::vector<VkImageView> scratchViews;
+        std::vector<VkDeviceMemory> scratchMemory;
+
+        std::vector<VkImage> outputs;
+        std::vector<VkImageView> outputStorageViews;
+        std::vector<VkImageView> outputViews;
+        std::vector<VkSampler> outputSamplers;
+        std::vector<VkDeviceMemory> outputMemory;
+
+        VkDescriptorSetLayout setLayout;
+        VkDescriptorPool pool;
+        VkPipelineLayout pipelineLayout;
+        // Rows then columns, for every frame
+        std::vector<VkDescriptorSet> sets;
+        VkPipeline pipeline;
+
+        void initImages(VkFormat format) {
+            uint32_t frames = static_cast<uint32_t>(sources.size());
+            VkImageViewType viewType = (layers > 1) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+
+            sourceViews.resize(frames);
+            scratch.resize(frames);
+            scratchViews.resize(frames);
+            scratchMemory.resize(frames);
+            outputs.resize(frames);
+            outputStorageViews.resize(frames);
+            outputViews.resize(frames);
+            outputSamplers.resize(frames);
+            outputMemory.resize(frames);
+
+            // The blur must not wrap around the edges, the water's reads of the output may
+            create::sampler(edgeSampler, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+            for (uint32_t i = 0; i < frames; i++) {
+                sourceViews[i] = create::imageView(sources[i], format, VK_IMAGE_ASPECT_COLOR_BIT, layers, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+
+                create::image(extent.width, extent.height, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, scratch[i], scratchMemory[i], FORMAT, 1, layers);
+                scratchViews[i] = create::imageView(scratch[i], FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, layers, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+                hw::loc::cmd()->transitionImageLayout(scratch[i], FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, layers);
+
+                create::image(extent.width, extent.height, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, outputs[i], outputMemory[i], FORMAT, 1, layers);
+                outputStorageViews[i] = create::imageView(outputs[i], FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, layers, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+                outputViews[i] = create::imageView(outputs[i], FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, layers, viewType);
+                create::sampler(outputSamplers[i]);
+            }
+        }
+
+        // Binding 0 is read through the sampler, binding 1 written
+        void initDescriptors() {
+            uint32_t frames = static_cast<uint32_t>(sources.size());
+
+            std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+            for (uint32_t i = 0; i < bindings.size(); i++) {
+                bindings[i].binding = i;
+                bindings[i].descriptorCount = 1;
+                bindings[i].descriptorType = (i == 0) ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            }
+
+            VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+            layoutInfo.pBindings = bindings.data();
+            hw::loc::device()->create(layoutInfo, setLayout);
+
+            // Texel step of the direction
+            VkPushConstantRange range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, 2 * sizeof(float)};
+
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pipelineLayoutInfo.setLayoutCount = 1;
+            pipelineLayoutInfo.pSetLayouts = &setLayout;
+            pipelineLayoutInfo.pushConstantRangeCount = 1;
+            pipelineLayoutInfo.pPushConstantRanges = &range;
+            hw::loc::device()->create(pipelineLayoutInfo, pipelineLayout);
+
+            std::array<VkDescriptorPoolSize, 2> poolSizes = {{
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * frames},
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * frames},
+            }};
+
+            VkDescriptorPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+            poolInfo.pPoolSizes = poolSizes.data();
+            poolInfo.maxSets = 2 * frames;
+            hw::loc::device()->create(poolInfo, pool);
+
+            std::vector<VkDescriptorSetLayout> layouts(2 * frames, setLayout);
+            sets.resize(2 * frames);
+
+            VkDescriptorSetAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = pool;
+            allocInfo.descriptorSetCount = 2 * frames;
+            allocInfo.pSetLayouts = layouts.data();
+            hw::loc::device()->allocate(allocInfo, sets.data());
+
+            for (uint32_t f = 0; f < frames; f++) {
+                // Source into scratch, then scratch into the output
+                std::array<VkImageView, 2> reads = {sourceViews[f], scratchViews[f]};
+                std::array<VkImageLayout, 2> readLayouts = {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL};
+                std::array<VkImageView, 2> writes = {scratchViews[f], outputStorageViews[f]};
+
+                for (uint32_t pass = 0; pass < 2; pass++) {
+                    VkDescriptorImageInfo readInfo = {edgeSampler, reads[pass], readLayouts[pass]};
+                    VkDescriptorImageInfo writeInfo = {VK_NULL_HANDLE, writes[pass], VK_IMAGE_LAYOUT_GENERAL};
+
+                    std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+                    for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+                        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                        descriptorWrites[i].dstSet = sets[2 * f + pass];
+                        descriptorWrites[i].dstBinding = i;
+                        descriptorWrites[i].descriptorCount = 1;
+                        descriptorWrites[i].descriptorType = bindings[i].descriptorType;
+                        descriptorWrites[i].pImageInfo = (i == 0) ? &readInfo : &writeInfo;
+                    }
+
+                    hw::loc::device()->update(static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data());
+                }
+            }
+        }
+};
@@ -82,6 +82,24 @@ class Camera {
                 gridHold = false;
             }
 
+            if ((glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) && (tilesHold != true)) {
+                tilesHold = true;
+                tilesMode = true;
+            } else tilesMode = false;
+
+            if (glfwGetKey(window, GLFW_KEY_T) == GLFW_RELEASE) {
+                tilesHold = false;
+            }
+
+            if ((glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) && (rainHold != true)) {
+                rainHold = true;
+                rainMode = true;
+            } else rainMode = false;
+
+            if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_RELEASE) {
+                rainHold = false;
+            }
+
             if (mousePressed) {
                 if (glm::abs(cameraFront.y) > 0.00001f) {
                     float t = (1 - cameraPos.y + 1) / cameraFront.y;
@@ -136,6 +154,10 @@ class Camera {
         bool gridMode = false;
         bool mousePressed = false;
         bool gridHold = false;
+        bool tilesMode = false;
+        bool tilesHold = false;
+        bool rainMode = false;
+        bool rainHold = false;
 
         glm::vec2 mousePosition = glm::vec2(0.0f, 0.0f);
 
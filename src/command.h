@@ -2,6 +2,7 @@
 
 #include <volk.h>
 
+#include <functional>
 #include <stdexcept>
 
 #include "locator.h"
@@ -95,8 +96,14 @@ namespace hw {
                 endSingleTimeCommands(commandBuffer);
             }
 
+            // Differing families make this the release or acquire half of an ownership transfer
             static void imageBarrier(VkCommandBuffer& buffer, VkImage& image, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage,
-                    VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t layers=1) {
+                    VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t layers=1,
+                    uint32_t srcFamily=VK_QUEUE_FAMILY_IGNORED, uint32_t dstFamily=VK_QUEUE_FAMILY_IGNORED, uint32_t mipLevel=0, uint32_t mipCount=1) {
+
+                if (srcFamily == dstFamily)
+                    srcFamily = dstFamily = VK_QUEUE_FAMILY_IGNORED;
+
 
                 VkImageMemoryBarrier barrier = {};
                 barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -105,12 +112,12 @@ namespace hw {
                 barrier.dstAccessMask = dstAccess;
                 barrier.oldLayout = oldLayout;
                 barrier.newLayout = newLayout;
-                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.srcQueueFamilyIndex = srcFamily;
+                barrier.dstQueueFamilyIndex = dstFamily;
                 barrier.image = image;
                 barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                barrier.subresourceRange.baseMipLevel = 0;
-                barrier.subresourceRange.levelCount = 1;
+                barrier.subresourceRange.baseMipLevel = mipLevel;
+                barrier.subresourceRange.levelCount = mipCount;
                 barrier.subresourceRange.baseArrayLayer = 0;
                 barrier.subresourceRange.layerCount = layers;
 
@@ -124,6 +131,34 @@ namespace hw {
                         1, &barrier);
             }
 
+            // Whole buffer, families as in imageBarrier
+            static void bufferBarrier(VkCommandBuffer& buffer, VkBuffer& target, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage,
+                    uint32_t srcFamily=VK_QUEUE_FAMILY_IGNORED, uint32_t dstFamily=VK_QUEUE_FAMILY_IGNORED) {
+
+                if (srcFamily == dstFamily)
+                    srcFamily = dstFamily = VK_QUEUE_FAMILY_IGNORED;
+
+                VkBufferMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.pNext = NULL;
+                barrier.srcAccessMask = srcAccess;
+                barrier.dstAccessMask = dstAccess;
+                barrier.srcQueueFamilyIndex = srcFamily;
+                barrier.dstQueueFamilyIndex = dstFamily;
+                barrier.buffer = target;
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+
+                vkCmdPipelineBarrier(
+                        buffer, 
+                        srcStage,
+                        dstStage,
+                        0,
+                        0, nullptr,
+                        1, &barrier,
+                        0, nullptr);
+            }
+
             static void barrier(VkCommandBuffer& buffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
                 VkMemoryBarrier midBarrier = {};
                 midBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
@@ -183,6 +218,17 @@ namespace hw {
                 endSingleTimeCommands(commandBuffer);
             }
 
+            // Recorded into a long lived buffer rather than submitted right away
+            static void copyBufferToImage(VkCommandBuffer& commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkImage image, uint32_t width, uint32_t height, VkImageLayout layout) {
+                VkBufferImageCopy region = {};
+                region.bufferOffset = offset;
+                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.layerCount = 1;
+                region.imageExtent = {width, height, 1};
+
+                vkCmdCopyBufferToImage(commandBuffer, buffer, image, layout, 1, &region);
+            }
+
             void copyBuffer(VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize size) {
                 VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
@@ -209,7 +255,7 @@ namespace hw {
                 hw::loc::device()->free(commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
             }
 
-            void customSingleCommand(bool func(VkCommandBuffer)) {
+            void customSingleCommand(const std::function<bool(VkCommandBuffer)>& func) {
                 VkCommandBuffer command_buffer = beginSingleTimeCommands();
                 func(command_buffer);
                 endSingleTimeCommands(command_buffer);
@@ -1,6 +1,10 @@
 #pragma once
 #include <volk.h>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -10,25 +14,159 @@
 #include <swapchain.h>
 #include <command.h>
 
+// Values for the constant_id slots of the compute shaders, in id order.
+// The grid extent is filled in from the Compute itself
+struct SimulationConstants {
+    uint32_t groupX = 16;
+    uint32_t groupY = 16;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    float relax = 1.985f;
+    uint32_t steps = 4;
+    float gravity = 9.81f;
+    float timestep = 0.05f;
+    float spacing = 1.0f;
+    float threshold = 0.001f;
+    uint32_t ring = 3;
+    float drain = 0.0f;
+};
+
 class Compute {
     public:
         VkExtent2D& extent() {
             return cboExtent;
         }
 
-        VkImage& color(u_int32_t frame, uint32_t index)
+        VkFormat format() {
+            return cboFormat;
+        }
+
+        VkImage& color(uint32_t index)
+        {
+            return colorImages[index];
+        }
+
+        VkImageView& colorView(uint32_t index)
+        {
+            return colorImageViews[index];
+        }
+
+        VkSampler& colorSampler(uint32_t index)
+        {
+            return colorSamplers[index];
+        }
+
+        // Copies of the newest (level 0) and the state before it (level 1) per frame,
+        // the only images the graphics queue samples
+        VkImage& snapshot(uint32_t frame, uint32_t level=0)
+        {
+            return snapshotImages[frame * SNAPSHOT_LEVELS + level];
+        }
+
+        VkImageView& snapshotView(uint32_t frame, uint32_t level=0)
+        {
+            return snapshotImageViews[frame * SNAPSHOT_LEVELS + level];
+        }
+
+        VkSampler& snapshotSampler(uint32_t frame, uint32_t level=0)
+        {
+            return snapshotSamplers[frame * SNAPSHOT_LEVELS + level];
+        }
+
+        // A storage buffer the solver writes next to the ring, copied per frame by publish like the
+        // snapshots so rendering never reads it while the compute queue does
+        void shareBuffer(VkBuffer source, VkDeviceSize size)
+        {
+            sharedSource = source;
+            sharedSize = size;
+            sharedBuffers.resize(snapshotImages.size() / SNAPSHOT_LEVELS);
+            sharedMemory.resize(sharedBuffers.size());
+
+            for (size_t i = 0; i < sharedBuffers.size(); i++)
+                create::buffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sharedBuffers[i], sharedMemory[i]);
+        }
+
+        VkBuffer& sharedBuffer(uint32_t frame)
+        {
+            return sharedBuffers[frame];
+        }
+
+        // Mip levels of each snapshot, only the first is published
+        uint32_t snapshotMips()
+        {
+            return mips;
+        }
+
+        // Graphics side, after acquire and outside a pass: blits the published first mip of the
+        // frame's snapshots down the rest of the chain and leaves all of it ready to sample
+        void downsample(VkCommandBuffer& buffer, uint32_t frame)
+        {
+            if (mips == 1)
+                return;
+
+            for (uint32_t level = 0; level < SNAPSHOT_LEVELS; level++) {
+                VkImage& image = snapshot(frame, level);
+
+                hw::Command::imageBarrier(buffer, image,
+                        VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+                for (uint32_t mip = 1; mip < mips; mip++) {
+                    hw::Command::imageBarrier(buffer, image,
+                            VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, mip);
+
+                    VkImageBlit blit = {};
+                    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip - 1, 0, 1};
+                    blit.srcOffsets[1] = {mipExtent(cboExtent.width, mip - 1), mipExtent(cboExtent.height, mip - 1), 1};
+                    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1};
+                    blit.dstOffsets[1] = {mipExtent(cboExtent.width, mip), mipExtent(cboExtent.height, mip), 1};
+
+                    vkCmdBlitImage(buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, filter);
+
+                    hw::Command::imageBarrier(buffer, image,
+                            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 1,
+                            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, mip);
+                }
+
+                hw::Command::imageBarrier(buffer, image,
+                        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1,
+                        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, 0, mips);
+            }
+        }
+
+        // Height gradients of the two snapshot levels, written by a compute pass rather than copied
+        VkImage& slopes(uint32_t frame)
         {
-            return colorImages[frame * hw::loc::swapChain()->size() + index];
+            return slopeImages[frame];
         }
 
-        VkImageView& colorView(u_int32_t frame, uint32_t index)
+        VkImageView& slopesView(uint32_t frame)
         {
-            return colorImageViews[frame * hw::loc::swapChain()->size() + index];
+            return slopeImageViews[frame];
         }
 
-        VkSampler& colorSampler(u_int32_t frame, uint32_t index)
+        VkSampler& slopesSampler(uint32_t frame)
         {
-            return colorSamplers[frame * hw::loc::swapChain()->size() + index];
+            return slopeSamplers[frame];
+        }
+
+        // Discards the frame's slopes ahead of the pass that rewrites them
+        void clearSlopes(VkCommandBuffer& buffer, uint32_t frame)
+        {
+            hw::Command::imageBarrier(buffer, slopeImages[frame],
+                    0, VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
         }
 
         VkPipeline& pipeline(uint32_t index)
@@ -38,21 +176,178 @@ class Compute {
 
         VkCommandBuffer& commandBuffer(uint32_t index)
         {
-            return commandBuffers[index];
+            return commandBuffer(index, rotation);
+        }
+
+        // Batch picks between buffers recorded for the same frame and rotation, like step counts
+        VkCommandBuffer& commandBuffer(uint32_t index, uint32_t _rotation, uint32_t batch=0)
+        {
+            return commandBuffers[(index * rotations + _rotation) * batches + batch];
+        }
+
+        uint32_t size()
+        {
+            return rotations;
         }
 
-        void addPipeline(VkPipelineLayout& layout, std::string_view compShader)
+        uint32_t current()
         {
-            Shader comp(compShader.data(), VK_SHADER_STAGE_COMPUTE_BIT);
+            return rotation;
+        }
+
+        void advance(uint32_t shift=1)
+        {
+            rotation = (rotation + shift) % rotations;
+        }
 
-            initPipe(comp, layout);
+        // Roles of the state images in a given rotation: a step reads prev
+        // and curr and writes next, which becomes curr on the following step.
+        // Kernels that advance two levels at once also write after
+        uint32_t prev(uint32_t _rotation)
+        {
+            return _rotation % rotations;
+        }
+
+        uint32_t curr(uint32_t _rotation)
+        {
+            return (_rotation + 1) % rotations;
         }
 
-        Compute(std::string_view _tag, uint32_t imageCount=1, uint32_t width=300, uint32_t height=300)
-            : tag(_tag) {
+        uint32_t next(uint32_t _rotation)
+        {
+            return (_rotation + 2) % rotations;
+        }
+
+        uint32_t after(uint32_t _rotation)
+        {
+            return (_rotation + 3) % rotations;
+        }
+
+        VkExtent2D& group(uint32_t index)
+        {
+            return groups[index];
+        }
 
-                initCBO(imageCount, width, height);
-                hw::loc::comp()->createCommandBuffers(commandBuffers, hw::loc::swapChain()->size());
+        void dispatch(VkCommandBuffer& buffer, uint32_t index)
+        {
+            vkCmdDispatch(buffer,
+                    (cboExtent.width + groups[index].width - 1) / groups[index].width,
+                    (cboExtent.height + groups[index].height - 1) / groups[index].height, 1);
+        }
+
+        // Copies state images newest and previous into the frame's snapshots and releases them and the
+        // slopes to the graphics family. Snapshots are overwritten whole, so their old contents never need to come back
+        void publish(VkCommandBuffer& buffer, uint32_t frame, uint32_t newest, uint32_t previous)
+        {
+            hw::Command::imageBarrier(buffer, slopeImages[frame],
+                    VK_ACCESS_SHADER_WRITE_BIT, 0,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1,
+                    computeFamily, graphicsFamily);
+
+            hw::Command::barrier(buffer,
+                    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+            std::array<uint32_t, SNAPSHOT_LEVELS> sources = {newest, previous};
+            for (uint32_t level = 0; level < SNAPSHOT_LEVELS; level++) {
+                hw::Command::imageBarrier(buffer, snapshot(frame, level),
+                        0, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+                VkImageCopy region = {};
+                region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+                region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+                region.extent = {cboExtent.width, cboExtent.height, 1};
+
+                vkCmdCopyImage(buffer, colorImages[sources[level]], VK_IMAGE_LAYOUT_GENERAL,
+                        snapshot(frame, level), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+                hw::Command::imageBarrier(buffer, snapshot(frame, level),
+                        VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1,
+                        computeFamily, graphicsFamily);
+            }
+
+            if (sharedSource != VK_NULL_HANDLE) {
+                VkBufferCopy region = {0, 0, sharedSize};
+                vkCmdCopyBuffer(buffer, sharedSource, sharedBuffers[frame], 1, &region);
+
+                hw::Command::bufferBarrier(buffer, sharedBuffers[frame],
+                        VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        computeFamily, graphicsFamily);
+            }
+        }
+
+        // Graphics side of publish, recorded before the snapshot is sampled. Starts at the
+        // stage the submit waits on, within one family the release already did the transition
+        void acquire(VkCommandBuffer& buffer, uint32_t frame)
+        {
+            if (computeFamily == graphicsFamily)
+                return;
+
+            for (uint32_t level = 0; level < SNAPSHOT_LEVELS; level++)
+                hw::Command::imageBarrier(buffer, snapshot(frame, level),
+                        0, VK_ACCESS_SHADER_READ_BIT,
+                        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1,
+                        computeFamily, graphicsFamily);
+
+            hw::Command::imageBarrier(buffer, slopeImages[frame],
+                    0, VK_ACCESS_SHADER_READ_BIT,
+                    VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1,
+                    computeFamily, graphicsFamily);
+
+            if (sharedSource != VK_NULL_HANDLE)
+                hw::Command::bufferBarrier(buffer, sharedBuffers[frame],
+                        0, VK_ACCESS_SHADER_READ_BIT,
+                        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        computeFamily, graphicsFamily);
+        }
+
+        // cellsX is how many cells along x one invocation steps, dispatch() covers the grid accordingly
+        void addPipeline(VkPipelineLayout& layout, std::string_view compShader, uint32_t groupX=16, uint32_t groupY=16, uint32_t cellsX=1)
+        {
+            sources.push_back({std::string(compShader), layout, cellsX});
+            pipelines.resize(pipelines.size() + 1);
+            groups.resize(groups.size() + 1);
+
+            initPipe(static_cast<uint32_t>(pipelines.size() - 1), groupX, groupY);
+        }
+
+        // Rebuilds a pipeline with another workgroup shape, nothing may be using the old one
+        void regroup(uint32_t index, uint32_t groupX, uint32_t groupY)
+        {
+            hw::loc::device()->destroy(pipelines[index]);
+            initPipe(index, groupX, groupY);
+        }
+
+        static const uint32_t SNAPSHOT_LEVELS = 2;
+
+        // Batches of command buffers per frame and rotation, frames defaults to the swapchain length.
+        // Mipmapped snapshots carry a full chain for downsample to fill
+        Compute(std::string_view _tag, uint32_t imageCount=1, uint32_t width=300, uint32_t height=300, VkFormat format=VK_FORMAT_R16G16B16A16_SFLOAT,
+                uint32_t frames=0, uint32_t _batches=1, bool mipmapped=false)
+            : tag(_tag), rotations(imageCount), batches(_batches) {
+
+                if (mipmapped)
+                    while ((std::max(width, height) >> mips) > 0)
+                        mips++;
+
+                if (frames == 0)
+                    frames = hw::loc::swapChain()->size();
+
+                hw::QueueFamilyIndices families = hw::loc::device()->findQueueFamilies();
+                computeFamily = families.computeFamily.value();
+                graphicsFamily = families.graphicsFamily.value();
+
+                initCBO(imageCount, width, height, format);
+                initSnapshots(frames);
+                hw::loc::comp()->createCommandBuffers(commandBuffers, frames * rotations * batches);
             }
 
         ~Compute() {
@@ -65,51 +360,180 @@ class Compute {
                 hw::loc::device()->free(colorMemory[i]);
             }
 
+            for (uint32_t i = 0; i < snapshotImages.size(); i++) {
+                hw::loc::device()->destroy(snapshotImages[i]);
+                hw::loc::device()->destroy(snapshotImageViews[i]);
+                hw::loc::device()->destroy(snapshotSamplers[i]);
+                hw::loc::device()->free(snapshotMemory[i]);
+            }
+
+            for (uint32_t i = 0; i < slopeImages.size(); i++) {
+                hw::loc::device()->destroy(slopeImages[i]);
+                hw::loc::device()->destroy(slopeImageViews[i]);
+                hw::loc::device()->destroy(slopeSamplers[i]);
+                hw::loc::device()->free(slopeMemory[i]);
+            }
+
+            for (uint32_t i = 0; i < sharedBuffers.size(); i++) {
+                hw::loc::device()->destroy(sharedBuffers[i]);
+                hw::loc::device()->free(sharedMemory[i]);
+            }
+
             for (auto& pipe : pipelines) {
                 hw::loc::device()->destroy(pipe);
             }
         }
 
         std::string tag;
+        SimulationConstants constants;
 
     private:
         VkExtent2D cboExtent;
+        VkFormat cboFormat;
+
+        uint32_t rotations;
+        uint32_t rotation = 0;
+        uint32_t batches;
+
+        uint32_t computeFamily;
+        uint32_t graphicsFamily;
 
         std::vector<VkCommandBuffer> commandBuffers;
         std::vector<VkPipeline> pipelines;
+        // Cells one workgroup of each pipeline covers
+        std::vector<VkExtent2D> groups;
+
+        // What each pipeline was built from, so regroup can rebuild it
+        struct PipelineSource {
+            std::string shader;
+            VkPipelineLayout layout;
+            uint32_t cellsX;
+        };
+        std::vector<PipelineSource> sources;
 
         std::vector<VkImage> colorImages;
         std::vector<VkImageView> colorImageViews;
         std::vector<VkDeviceMemory> colorMemory;
         std::vector<VkSampler> colorSamplers;
 
-        void initCBO(uint32_t imageCount, uint32_t width, uint32_t height) 
+        std::vector<VkImage> snapshotImages;
+        std::vector<VkImageView> snapshotImageViews;
+        std::vector<VkDeviceMemory> snapshotMemory;
+        std::vector<VkSampler> snapshotSamplers;
+        uint32_t mips = 1;
+
+        VkBuffer sharedSource = VK_NULL_HANDLE;
+        VkDeviceSize sharedSize = 0;
+        std::vector<VkBuffer> sharedBuffers;
+        std::vector<VkDeviceMemory> sharedMemory;
+
+        std::vector<VkImage> slopeImages;
+        std::vector<VkImageView> slopeImageViews;
+        std::vector<VkDeviceMemory> slopeMemory;
+        std::vector<VkSampler> slopeSamplers;
+        VkFilter filter;
+
+        static int32_t mipExtent(uint32_t extent, uint32_t mip)
+        {
+            return static_cast<int32_t>(std::max(extent >> mip, 1u));
+        }
+
+        void initCBO(uint32_t imageCount, uint32_t width, uint32_t height, VkFormat format) 
         {
             cboExtent = {width, height};
+            cboFormat = hw::loc::device()->find({format}, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 
-            colorImages.resize(imageCount * hw::loc::swapChain()->size());
-            colorImageViews.resize(imageCount * hw::loc::swapChain()->size());
-            colorMemory.resize(imageCount * hw::loc::swapChain()->size());
-            colorSamplers.resize(imageCount * hw::loc::swapChain()->size());
+            // Sized by the solver alone, every frame shares the one ring
+            colorImages.resize(imageCount);
+            colorImageViews.resize(imageCount);
+            colorMemory.resize(imageCount);
+            colorSamplers.resize(imageCount);
+
+            // R32_SFLOAT is not guaranteed to filter linearly
+            filter = hw::loc::device()->supports(cboFormat, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+                ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
 
             VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
             #pragma omp parallel for
-            for (size_t i = 0; i < imageCount * hw::loc::swapChain()->size(); i++) {
-                create::image(width, height, usage, colorImages[i], colorMemory[i], VK_FORMAT_R16G16B16A16_SFLOAT);
-                colorImageViews[i] = create::imageView(colorImages[i], VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
-                create::sampler(colorSamplers[i]);
+            for (size_t i = 0; i < imageCount; i++) {
+                create::image(width, height, usage, colorImages[i], colorMemory[i], cboFormat);
+                colorImageViews[i] = create::imageView(colorImages[i], cboFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+                create::sampler(colorSamplers[i], VK_SAMPLER_ADDRESS_MODE_REPEAT, filter);
             }
         }
 
-        void initPipe(Shader& shader, VkPipelineLayout& layout) {
+        void initSnapshots(uint32_t frames)
+        {
+            uint32_t count = frames * SNAPSHOT_LEVELS;
+
+            VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            if (mips > 1)
+                usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+            snapshotImages.resize(count);
+            snapshotImageViews.resize(count);
+            snapshotMemory.resize(count);
+            snapshotSamplers.resize(count);
+
+            #pragma omp parallel for
+            for (size_t i = 0; i < count; i++) {
+                create::image(cboExtent.width, cboExtent.height, usage, snapshotImages[i], snapshotMemory[i], cboFormat, mips);
+                snapshotImageViews[i] = create::imageView(snapshotImages[i], cboFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_VIEW_TYPE_2D, mips);
+                create::sampler(snapshotSamplers[i], VK_SAMPLER_ADDRESS_MODE_REPEAT, filter, static_cast<float>(mips - 1));
+            }
+
+            slopeImages.resize(frames);
+            slopeImageViews.resize(frames);
+            slopeMemory.resize(frames);
+            slopeSamplers.resize(frames);
+
+            #pragma omp parallel for
+            for (size_t i = 0; i < frames; i++) {
+                create::image(cboExtent.width, cboExtent.height, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, slopeImages[i], slopeMemory[i], VK_FORMAT_R16G16B16A16_SFLOAT);
+                slopeImageViews[i] = create::imageView(slopeImages[i], VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
+                create::sampler(slopeSamplers[i], VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+            }
+        }
+
+        void initPipe(uint32_t index, uint32_t groupX, uint32_t groupY) {
+            Shader shader(sources[index].shader.data(), VK_SHADER_STAGE_COMPUTE_BIT);
+
+            SimulationConstants values = constants;
+            values.groupX = groupX;
+            values.groupY = groupY;
+            values.width = cboExtent.width;
+            values.height = cboExtent.height;
+
+            std::array<VkSpecializationMapEntry, 12> entries = {{
+                {0, offsetof(SimulationConstants, groupX), sizeof(uint32_t)},
+                {1, offsetof(SimulationConstants, groupY), sizeof(uint32_t)},
+                {2, offsetof(SimulationConstants, width), sizeof(uint32_t)},
+                {3, offsetof(SimulationConstants, height), sizeof(uint32_t)},
+                {4, offsetof(SimulationConstants, relax), sizeof(float)},
+                {5, offsetof(SimulationConstants, steps), sizeof(uint32_t)},
+                {6, offsetof(SimulationConstants, gravity), sizeof(float)},
+                {7, offsetof(SimulationConstants, timestep), sizeof(float)},
+                {8, offsetof(SimulationConstants, spacing), sizeof(float)},
+                {9, offsetof(SimulationConstants, threshold), sizeof(float)},
+                {10, offsetof(SimulationConstants, ring), sizeof(uint32_t)},
+                {11, offsetof(SimulationConstants, drain), sizeof(float)},
+            }};
+
+            VkSpecializationInfo specializationInfo = {};
+            specializationInfo.mapEntryCount = static_cast<uint32_t>(entries.size());
+            specializationInfo.pMapEntries = entries.data();
+            specializationInfo.dataSize = sizeof(values);
+            specializationInfo.pData = &values;
+
             VkComputePipelineCreateInfo pipelineInfo = {};
             pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-            pipelineInfo.layout = layout;
+            pipelineInfo.layout = sources[index].layout;
             pipelineInfo.flags = 0;
             pipelineInfo.stage = shader.info();
+            pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
 
-            pipelines.resize(pipelines.size() + 1);
-            hw::loc::device()->create(pipelineInfo, pipelines[pipelines.size() - 1]);
+            groups[index] = {groupX * sources[index].cellsX, groupY};
+            hw::loc::device()->create(pipelineInfo, pipelines[index]);
         }
 };
@@ -0,0 +1,59 @@
+#include "cpusolver.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// cpu_bench [width] [height] [steps]
+int main(int argc, char** argv) {
+    uint32_t width = (argc > 1) ? std::atoi(argv[1]) : 1024;
+    uint32_t height = (argc > 2) ? std::atoi(argv[2]) : 1024;
+    uint32_t steps = (argc > 3) ? std::atoi(argv[3]) : 200;
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    CpuSolver solver(width, height);
+
+    std::vector<float> heights(static_cast<size_t>(width) * height);
+    for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+            heights[static_cast<size_t>(y) * width + x] = 0.5f * std::sin(x * 0.05f) * std::cos(y * 0.05f);
+    solver.reset(heights);
+
+    Impulse impulse;
+    impulse.x = 0.5f;
+    impulse.y = 0.5f;
+
+    // Warm up caches and the thread pool
+    for (uint32_t i = 0; i < 10; i++) {
+        solver.step();
+        solver.splat(impulse);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < steps; i++) {
+        solver.step();
+        if (i % 16 == 0)
+            solver.splat(impulse);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double rate = static_cast<double>(solver.cells()) * steps / seconds;
+
+    std::cout << "isa: " << solver.isa() << std::endl;
+    std::cout << "grid: " << width << "x" << height << ", steps: " << steps << ", threads: " << threads << std::endl;
+    std::cout << "time: " << seconds * 1000.0 / steps << " ms/step" << std::endl;
+    std::cout << "cells/s: " << rate << std::endl;
+    std::cout << "cells/s/core: " << rate / threads << std::endl;
+
+    return EXIT_SUCCESS;
+}
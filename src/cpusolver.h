@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "impulse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_SOLVER_X86
+#endif
+
+// One row of simulation.comp: rows outside the grid are passed as zeros
+typedef void (*CpuSolverRow)(const float* prev, const float* up, const float* curr, const float* down,
+        float* next, uint32_t width, float relax);
+
+namespace cpusolver {
+    inline float cell(const float* prev, const float* up, const float* curr, const float* down,
+            uint32_t x, uint32_t width, float relax) {
+        float left = (x > 0) ? curr[x - 1] : 0.0f;
+        float right = (x + 1 < width) ? curr[x + 1] : 0.0f;
+
+        float height = (1.0f - relax) * prev[x] + relax * 0.25f * (up[x] + down[x] + left + right);
+        return std::clamp(height, -1.0f, 1.0f);
+    }
+
+    inline void scalar(const float* prev, const float* up, const float* curr, const float* down,
+            float* next, uint32_t width, float relax) {
+        for (uint32_t x = 0; x < width; x++)
+            next[x] = cell(prev, up, curr, down, x, width, relax);
+    }
+
+#ifdef CPU_SOLVER_X86
+    __attribute__((target("avx2,fma")))
+    inline void avx2(const float* prev, const float* up, const float* curr, const float* down,
+            float* next, uint32_t width, float relax) {
+        const __m256 keep = _mm256_set1_ps(1.0f - relax);
+        const __m256 spread = _mm256_set1_ps(relax * 0.25f);
+        const __m256 lo = _mm256_set1_ps(-1.0f);
+        const __m256 hi = _mm256_set1_ps(1.0f);
+
+        uint32_t x = 1;
+        next[0] = cell(prev, up, curr, down, 0, width, relax);
+
+        for (; x + 8 < width; x += 8) {
+            __m256 sum = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_loadu_ps(up + x), _mm256_loadu_ps(down + x)),
+                    _mm256_add_ps(_mm256_loadu_ps(curr + x - 1), _mm256_loadu_ps(curr + x + 1)));
+
+            __m256 height = _mm256_fmadd_ps(keep, _mm256_loadu_ps(prev + x), _mm256_mul_ps(spread, sum));
+            _mm256_storeu_ps(next + x, _mm256_min_ps(_mm256_max_ps(height, lo), hi));
+        }
+
+        for (; x < width; x++)
+            next[x] = cell(prev, up, curr, down, x, width, relax);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void avx512(const float* prev, const float* up, const float* curr, const float* down,
+            float* next, uint32_t width, float relax) {
+        const __m512 keep = _mm512_set1_ps(1.0f - relax);
+        const __m512 spread = _mm512_set1_ps(relax * 0.25f);
+        const __m512 lo = _mm512_set1_ps(-1.0f);
+        const __m512 hi = _mm512_set1_ps(1.0f);
+
+        uint32_t x = 1;
+        next[0] = cell(prev, up, curr, down, 0, width, relax);
+
+        for (; x + 16 < width; x += 16) {
+            __m512 sum = _mm512_add_ps(
+                    _mm512_add_ps(_mm512_loadu_ps(up + x), _mm512_loadu_ps(down + x)),
+                    _mm512_add_ps(_mm512_loadu_ps(curr + x - 1), _mm512_loadu_ps(curr + x + 1)));
+
+            __m512 height = _mm512_fmadd_ps(keep, _mm512_loadu_ps(prev + x), _mm512_mul_ps(spread, sum));
+            _mm512_storeu_ps(next + x, _mm512_min_ps(_mm512_max_ps(height, lo), hi));
+        }
+
+        for (; x < width; x++)
+            next[x] = cell(prev, up, curr, down, x, width, relax);
+    }
+#endif
+}
+
+// CPU reference of simulation.comp, same ring of prev/curr/next as Compute
+class CpuSolver {
+    public:
+        // Rows handed to one thread at a time, so up/curr/down stay in cache
+        static const uint32_t ROW_BLOCK = 16;
+
+        CpuSolver(uint32_t _width, uint32_t _height, float _relax=1.985f)
+            : width(_width), height(_height), relax(_relax), zeros(_width, 0.0f) {
+
+                for (auto& level : levels)
+                    level.assign(static_cast<size_t>(width) * height, 0.0f);
+
+                pick();
+            }
+
+        // Both starting levels, like the heightmap upload of the GPU path
+        void reset(const std::vector<float>& heights) {
+            levels[prev()] = heights;
+            levels[curr()] = heights;
+            rotation = 0;
+        }
+
+        void step() {
+            const float* p = levels[prev()].data();
+            const float* c = levels[curr()].data();
+            float* n = levels[next()].data();
+
+            uint32_t blocks = (height + ROW_BLOCK - 1) / ROW_BLOCK;
+
+            #pragma omp parallel for schedule(static)
+            for (uint32_t block = 0; block < blocks; block++) {
+                uint32_t end = std::min(height, (block + 1) * ROW_BLOCK);
+
+                for (uint32_t y = block * ROW_BLOCK; y < end; y++) {
+                    size_t offset = static_cast<size_t>(y) * width;
+                    const float* up = (y > 0) ? c + offset - width : zeros.data();
+                    const float* down = (y + 1 < height) ? c + offset + width : zeros.data();
+
+                    row(p + offset, up, c + offset, down, n + offset, width, relax);
+                }
+            }
+
+            rotation = (rotation + 1) % 3;
+        }
+
+        // Applied to the newest level like the splat dispatch after a GPU step, left unclamped like there
+        void splat(const Impulse& impulse) {
+            float* n = levels[curr()].data();
+            float centreX = impulse.x * width;
+            float centreY = impulse.y * height;
+
+            int x0 = std::max(0, static_cast<int>(std::ceil(centreX - impulse.radius)));
+            int x1 = std::min(static_cast<int>(width) - 1, static_cast<int>(std::floor(centreX + impulse.radius)));
+            int y0 = std::max(0, static_cast<int>(std::ceil(centreY - impulse.radius)));
+            int y1 = std::min(static_cast<int>(height) - 1, static_cast<int>(std::floor(centreY + impulse.radius)));
+
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++) {
+                    float& cell = n[static_cast<size_t>(y) * width + x];
+                    cell = impulseHeight(impulse, x - centreX, y - centreY, cell);
+                }
+        }
+
+        // Newest level, what the GPU path would leave in curr
+        const std::vector<float>& state() {
+            return levels[curr()];
+        }
+
+        // Level one step older than state()
+        const std::vector<float>& previous() {
+            return levels[prev()];
+        }
+
+        std::string_view isa() {
+            return isaName;
+        }
+
+        uint32_t cells() {
+            return width * height;
+        }
+
+    private:
+        uint32_t width;
+        uint32_t height;
+        float relax;
+
+        uint32_t rotation = 0;
+        std::array<std::vector<float>, 3> levels;
+        std::vector<float> zeros;
+
+        CpuSolverRow row = cpusolver::scalar;
+        std::string_view isaName = "scalar";
+
+        uint32_t prev() { return rotation; }
+        uint32_t curr() { return (rotation + 1) % 3; }
+        uint32_t next() { return (rotation + 2) % 3; }
+
+        void pick() {
+        #ifdef CPU_SOLVER_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                row = cpusolver::avx512;
+                isaName = "avx512";
+            } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                row = cpusolver::avx2;
+                isaName = "avx2";
+            }
+        #endif
+        }
+
+};
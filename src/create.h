@@ -4,6 +4,9 @@
 
 #include <vector>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
 #include "locator.h"
 #include "device.h"
 #include "vertex.h"
@@ -33,7 +36,7 @@ struct create {
         hw::loc::device()->bind(buffer, bufferMemory);
     }
 
-    static VkImageView imageView(VkImage& image, VkFormat format=VK_FORMAT_R8G8B8A8_SRGB, VkImageAspectFlags aspectFlags=VK_IMAGE_ASPECT_COLOR_BIT, int layerCount=1, VkImageViewType viewType=VK_IMAGE_VIEW_TYPE_2D) {
+    static VkImageView imageView(VkImage& image, VkFormat format=VK_FORMAT_R8G8B8A8_SRGB, VkImageAspectFlags aspectFlags=VK_IMAGE_ASPECT_COLOR_BIT, int layerCount=1, VkImageViewType viewType=VK_IMAGE_VIEW_TYPE_2D, uint32_t mipLevels=1) {
         VkImageViewCreateInfo viewInfo = {};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = image;
@@ -41,7 +44,7 @@ struct create {
         viewInfo.format = format;
         viewInfo.subresourceRange.aspectMask = aspectFlags;
         viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.levelCount = mipLevels;
         viewInfo.subresourceRange.baseArrayLayer = 0;
         viewInfo.subresourceRange.layerCount = layerCount;
 
@@ -51,11 +54,11 @@ struct create {
         return imageView;
     }
 
-    static void sampler(VkSampler& sampler, VkSamplerAddressMode addressMode=VK_SAMPLER_ADDRESS_MODE_REPEAT) {
+    static void sampler(VkSampler& sampler, VkSamplerAddressMode addressMode=VK_SAMPLER_ADDRESS_MODE_REPEAT, VkFilter filter=VK_FILTER_LINEAR, float maxLod=0.0f) {
         VkSamplerCreateInfo samplerInfo = {};
         samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        samplerInfo.magFilter = VK_FILTER_LINEAR;
-        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.magFilter = filter;
+        samplerInfo.minFilter = filter;
         samplerInfo.addressModeU = addressMode;
         samplerInfo.addressModeV = addressMode;
         samplerInfo.addressModeW = addressMode;
@@ -66,6 +69,7 @@ struct create {
         samplerInfo.compareEnable = VK_FALSE;
         samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
         samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.maxLod = maxLod;
 
         hw::loc::device()->create(samplerInfo, sampler);
     }
@@ -169,15 +173,107 @@ struct create {
 
     }
 
-    static void image(uint32_t width, uint32_t height, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& imageMemory, VkFormat format=VK_FORMAT_R8G8B8A8_SRGB) {
+    // Height in .r of an image, nearest resampled to the target size
+    static std::vector<float> heightmap(std::string_view filename, uint32_t width, uint32_t height) {
+        stbi_ldr_to_hdr_gamma(1.0f);
+
+        int texWidth, texHeight, texChannels;
+        float* pixels = stbi_loadf(filename.data(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+        if (!pixels) {
+            throw std::runtime_error("failed to load texture image!");
+        }
+
+        std::vector<float> heights(static_cast<size_t>(width) * height);
+
+        #pragma omp parallel for
+        for (uint32_t y = 0; y < height; y++)
+            for (uint32_t x = 0; x < width; x++) {
+                size_t src = static_cast<size_t>(y) * texHeight / height * texWidth + static_cast<size_t>(x) * texWidth / width;
+                heights[static_cast<size_t>(y) * width + x] = pixels[src * 4];
+            }
+
+        stbi_image_free(pixels);
+
+        return heights;
+    }
+
+    static size_t texelSize(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_R16_SFLOAT: return sizeof(uint16_t);
+            case VK_FORMAT_R32_SFLOAT: return sizeof(float);
+            case VK_FORMAT_R16G16_SFLOAT: return 2 * sizeof(uint16_t);
+            case VK_FORMAT_R16G16B16A16_SFLOAT: return 4 * sizeof(uint16_t);
+            default: throw std::runtime_error("unsupported simulation format!");
+        }
+    }
+
+    // Each channel of a texel is scale * height + offset, R16G16_SFLOAT starts with curr and prev equal
+    static void texels(const std::vector<float>& heights, VkFormat format, void* data,
+            glm::vec4 scale=glm::vec4(1.0f), glm::vec4 offset=glm::vec4(0.0f)) {
+        size_t texel = texelSize(format);
+        char* texels = static_cast<char*>(data);
+
+        #pragma omp parallel for
+        for (size_t i = 0; i < heights.size(); i++) {
+            char* dst = texels + i * texel;
+            glm::vec4 value = scale * heights[i] + offset;
+
+            if (format == VK_FORMAT_R32_SFLOAT) {
+                memcpy(dst, &value.x, sizeof(float));
+            } else {
+                for (size_t c = 0; c < texel / sizeof(uint16_t); c++) {
+                    uint16_t half = glm::packHalf1x16(value[c]);
+                    memcpy(dst + c * sizeof(uint16_t), &half, sizeof(uint16_t));
+                }
+            }
+        }
+    }
+
+    // Back from texels, only the first channel of each
+    static std::vector<float> heights(const void* data, VkFormat format, size_t count) {
+        size_t texel = texelSize(format);
+        const char* texels = static_cast<const char*>(data);
+        std::vector<float> heights(count);
+
+        #pragma omp parallel for
+        for (size_t i = 0; i < count; i++) {
+            const char* src = texels + i * texel;
+
+            if (format == VK_FORMAT_R32_SFLOAT) {
+                memcpy(&heights[i], src, sizeof(float));
+            } else {
+                uint16_t half;
+                memcpy(&half, src, sizeof(uint16_t));
+                heights[i] = glm::unpackHalf1x16(half);
+            }
+        }
+
+        return heights;
+    }
+
+    static void staging(std::string_view filename, uint32_t width, uint32_t height, VkFormat format, VkBuffer& stagingBuffer, VkDeviceMemory& stagingBufferMemory,
+            glm::vec4 scale=glm::vec4(1.0f), glm::vec4 offset=glm::vec4(0.0f)) {
+        std::vector<float> heights = heightmap(filename, width, height);
+        VkDeviceSize imageSize = heights.size() * texelSize(format);
+
+        create::buffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* data;
+        hw::loc::device()->map(stagingBufferMemory, imageSize, data);
+        texels(heights, format, data, scale, offset);
+        hw::loc::device()->unmap(stagingBufferMemory);
+    }
+
+    static void image(uint32_t width, uint32_t height, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& imageMemory, VkFormat format=VK_FORMAT_R8G8B8A8_SRGB, uint32_t mipLevels=1, uint32_t layers=1) {
         VkImageCreateInfo imageInfo = {};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
         imageInfo.extent.width = width;
         imageInfo.extent.height = height;
         imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = layers;
         imageInfo.format = format;
         imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
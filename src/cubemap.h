@@ -49,7 +49,6 @@ class CubeMap : public Image {
             VkDeviceSize imageSize = texWidth * texHeight * 4;
             VkDeviceSize cubeMapSize = texWidth * texHeight * 4 * 6;
 
-            #pragma omp parallel for
             for (int i = 0; i < 6; i++)
                 if (!pixels[i])
                     throw std::runtime_error("failed to load cubemap image!");
@@ -104,7 +104,6 @@ class Descriptor {
             {
                 meshes.push_back(new Mesh(_tag, descriptorLayouts.size(), _sets.size(), _dimensions, _transform, _rotation, _scale));
 
-                #pragma omp parallel for
                 for (auto& set: _sets) {
                     for (auto& type: layoutTypes[set].types) {
                         descriptorTypes[type]++;
@@ -128,7 +127,6 @@ class Descriptor {
             {
                 meshes.push_back(new Mesh(_tag, descriptorLayouts.size(), _sets.size(), _transform, _rotation, _scale));
 
-                #pragma omp parallel for
                 for (auto& set: _sets) {
                     for (auto& type: layoutTypes[set].types) {
                         descriptorTypes[type]++;
@@ -152,7 +150,6 @@ class Descriptor {
             {
                 meshes.push_back(new Mesh(_tag, descriptorLayouts.size(), _sets.size(), model, _texture, _transform, _rotation, _scale));
 
-                #pragma omp parallel for
                 for (auto& set: _sets) {
                     for (auto& type: layoutTypes[set].types) {
                         descriptorTypes[type]++;
@@ -188,7 +185,6 @@ class Descriptor {
 
             descriptorSets.resize(hw::loc::swapChain()->size());
 
-            #pragma omp parallel for
             for (auto& sets: descriptorSets) {
                 VkDescriptorSetAllocateInfo allocInfo = {};
                 allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -224,6 +220,7 @@ class Descriptor {
             descriptorTypes[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] = 0;
             descriptorTypes[VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER] = 0;
             descriptorTypes[VK_DESCRIPTOR_TYPE_STORAGE_IMAGE] = 0;
+            descriptorTypes[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER] = 0;
         }
 
         ~Descriptor() {
@@ -249,6 +246,12 @@ class Descriptor {
             else vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout(layout), 0, mesh->descriptor.size, &descriptorSets[frame][mesh->descriptor.start], 0, nullptr);
         }
 
+        void bindDescriptor(VkCommandBuffer& buffer, Mesh* mesh, uint32_t frame, uint32_t descriptor, uint32_t layout, bool compute=false) {
+            if (compute)
+                vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout(layout), 0, 1, &getDescriptor(mesh, frame, descriptor), 0, nullptr);
+            else vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout(layout), 0, 1, &getDescriptor(mesh, frame, descriptor), 0, nullptr);
+        }
+
         VkBuffer& getUniBuffer(Mesh* mesh, uint32_t frame, uint32_t buffer) {
             if (mesh->uniform.size <= buffer)
                 std::runtime_error("No more descriptors for mesh");
@@ -34,7 +34,8 @@ namespace hw {
 
     class Device {
         public:
-            Device(bool _evl) : enableValidationLayers(_evl) {
+            // Headless devices skip the swapchain and surface, for sim_bench
+            Device(bool _evl, bool _headless=false) : enableValidationLayers(_evl), headless(_headless) {
                 uint32_t deviceCount = 0;
                 vkEnumeratePhysicalDevices(hw::loc::instance()->get(), &deviceCount, nullptr);
 
@@ -62,7 +63,28 @@ namespace hw {
                 VkPhysicalDeviceProperties info;
                 vkGetPhysicalDeviceProperties(physicalDevice, &info);
 
-                std::cout << info.deviceName << std::endl;
+                std::cerr << info.deviceName << std::endl;
+                timestampPeriod = info.limits.timestampPeriod;
+
+                uint32_t familyCount = 0;
+                vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+                std::vector<VkQueueFamilyProperties> families(familyCount);
+                vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+                timestampBits = families[indices.computeFamily.value()].timestampValidBits;
+                graphicsTimestampBits = families[indices.graphicsFamily.value()].timestampValidBits;
+                storageAlignment = info.limits.minStorageBufferOffsetAlignment;
+
+                VkPhysicalDeviceSubgroupProperties subgroupProperties = {};
+                subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+                VkPhysicalDeviceProperties2 properties2 = {};
+                properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+                properties2.pNext = &subgroupProperties;
+                vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+                subgroupSize = subgroupProperties.subgroupSize;
+                subgroupShuffle = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+                    && (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_SHUFFLE_RELATIVE_BIT);
 
                 std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
                 std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(), indices.computeFamily.value()};
@@ -80,9 +102,14 @@ namespace hw {
                 VkPhysicalDeviceFeatures deviceFeatures = {};
                 deviceFeatures.samplerAnisotropy = VK_TRUE;
                 deviceFeatures.shaderClipDistance = VK_TRUE;
-                deviceFeatures.geometryShader = VK_TRUE;
                 deviceFeatures.fillModeNonSolid = VK_TRUE;
 
+                // r16f, r32f and rg16f storage images for the simulation state
+                VkPhysicalDeviceFeatures supportedFeatures;
+                vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+                deviceFeatures.shaderStorageImageExtendedFormats = supportedFeatures.shaderStorageImageExtendedFormats;
+                storageImageExtendedFormats = supportedFeatures.shaderStorageImageExtendedFormats;
+
                 VkDeviceCreateInfo createInfo = {};
                 createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -91,8 +118,39 @@ namespace hw {
 
                 createInfo.pEnabledFeatures = &deviceFeatures;
 
-                createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-                createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+                // Simulation and rendering hand frames over through a timeline semaphore
+                VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+                vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+                vulkan12Features.timelineSemaphore = VK_TRUE;
+                createInfo.pNext = &vulkan12Features;
+
+                // Half precision arithmetic for the opt-in fp16 kernel, wherever the device has it
+                VkPhysicalDeviceVulkan12Features supported12 = {};
+                supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+                // Reflection and refraction share one multiview pass where the device can
+                VkPhysicalDeviceVulkan11Features supported11 = {};
+                supported11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+                supported11.pNext = &supported12;
+
+                VkPhysicalDeviceFeatures2 features2 = {};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+                features2.pNext = &supported11;
+                vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+                shaderFloat16 = supported12.shaderFloat16;
+                vulkan12Features.shaderFloat16 = supported12.shaderFloat16;
+
+                VkPhysicalDeviceVulkan11Features vulkan11Features = {};
+                vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+                vulkan11Features.multiview = supported11.multiview;
+                vulkan12Features.pNext = &vulkan11Features;
+                multiview = supported11.multiview;
+
+                if (!headless) {
+                    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+                    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+                }
 
                 if (enableValidationLayers) {
                     createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -113,6 +171,7 @@ namespace hw {
             }
 
             ~Device() {
+                destroyTimestamps();
                 vkDestroyDevice(device, nullptr);
             }
 
@@ -143,10 +202,27 @@ namespace hw {
                 vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
             }
 
+            // Waits for the queries, 64 bit ticks
+            void get(VkQueryPool& queryPool, uint32_t first, uint32_t count, uint64_t* results) {
+                if (vkGetQueryPoolResults(device, queryPool, first, count, count * sizeof(uint64_t), results, sizeof(uint64_t),
+                            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to get query results!");
+                }
+            }
+
+            // Highest value a timeline semaphore has been signalled with
+            void get(VkSemaphore& semaphore, uint64_t& value) {
+                vkGetSemaphoreCounterValue(device, semaphore, &value);
+            }
+
             void get(VkPhysicalDeviceMemoryProperties& memProperties) {
                 vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
             }
 
+            void get(VkPhysicalDeviceProperties& properties) {
+                vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            }
+
             void map(VkDeviceMemory& bufferMemory, VkDeviceSize size, void* &data) {
                 vkMapMemory(device, bufferMemory, 0, size, 0, &data);
             }
@@ -251,6 +327,12 @@ namespace hw {
                 }
             }
 
+            void create(VkQueryPoolCreateInfo& poolInfo, VkQueryPool& queryPool) {
+                if (vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create query pool!");
+                }
+            }
+
             void allocate(VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& imageMemory) {
                 if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
                     throw std::runtime_error("failed to allocate image memory!");
@@ -385,6 +467,10 @@ namespace hw {
                 vkDestroyCommandPool(device, commandPool, nullptr);
             }
 
+            void destroy(VkQueryPool& queryPool) {
+                vkDestroyQueryPool(device, queryPool, nullptr);
+            }
+
             void destroy(VkShaderModule& shaderModule) {
                 vkDestroyShaderModule(device, shaderModule, nullptr);
             }
@@ -430,14 +516,18 @@ namespace hw {
                 throw std::runtime_error("failed to find suitable memory type!");
             }
 
+            bool supports(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) {
+                VkFormatProperties props;
+                get(format, props);
+
+                if (tiling == VK_IMAGE_TILING_LINEAR)
+                    return (props.linearTilingFeatures & features) == features;
+                return (props.optimalTilingFeatures & features) == features;
+            }
+
             VkFormat find(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
                 for (VkFormat format : candidates) {
-                    VkFormatProperties props;
-                    get(format, props);
-
-                    if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
-                        return format;
-                    } else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
+                    if (supports(format, tiling, features)) {
                         return format;
                     }
                 }
@@ -445,9 +535,117 @@ namespace hw {
                 throw std::runtime_error("failed to find supported format!");
             }
 
+            // shaderStorageImageExtendedFormats was enabled, shaders may declare r16f, r32f and rg16f images
+            bool storageImageExtendedFormats = false;
+
+            // Nanoseconds per timestamp tick
+            float timestampPeriod = 1.0f;
+            // Valid bits of the compute queue's timestamps, 0 when it cannot write any
+            uint32_t timestampBits = 64;
+            // The same for the graphics queue
+            uint32_t graphicsTimestampBits = 64;
+            // Storage buffer descriptors have to start on a multiple of this
+            VkDeviceSize storageAlignment = 1;
+            // Invocations per subgroup, and whether compute shaders can shuffle up and down within one
+            uint32_t subgroupSize = 1;
+            bool subgroupShuffle = false;
+            // shaderFloat16 was enabled, float16_t arithmetic is allowed in shaders
+            bool shaderFloat16 = false;
+            // multiview was enabled, render passes can draw several views at once
+            bool multiview = false;
+
+            // Nanoseconds between two timestamps of a queue with bits valid bits, the ticks wrap past them
+            double elapsed(uint64_t begin, uint64_t end) {
+                return elapsed(begin, end, timestampBits);
+            }
+
+            double elapsed(uint64_t begin, uint64_t end, uint32_t bits) {
+                uint64_t mask = (bits >= 64) ? ~0ull : (1ull << bits) - 1;
+                return static_cast<double>((end - begin) & mask) * timestampPeriod;
+            }
+
+            // A begin and end query per pass and frame, reset once with resetTimestamps
+            // before the first read. Bit n of computePasses puts pass n on the compute queue
+            void createTimestamps(uint32_t frames, uint32_t passes, uint32_t computePasses) {
+                destroyTimestamps();
+
+                timestampPasses = passes;
+                timestampComputePasses = computePasses;
+                timestampQueries = frames * passes * 2;
+
+                VkQueryPoolCreateInfo poolInfo = {};
+                poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+                poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+                poolInfo.queryCount = timestampQueries;
+
+                create(poolInfo, timestampPool);
+            }
+
+            void destroyTimestamps() {
+                if (timestampPool != VK_NULL_HANDLE) {
+                    destroy(timestampPool);
+                    timestampPool = VK_NULL_HANDLE;
+                }
+            }
+
+            void resetTimestamps(VkCommandBuffer buffer) {
+                vkCmdResetQueryPool(buffer, timestampPool, 0, timestampQueries);
+            }
+
+            // Valid bits of the queue pass runs on, passes on a queue without timestamps write none
+            uint32_t passBits(uint32_t pass) {
+                return ((timestampComputePasses >> pass) & 1) ? timestampBits : graphicsTimestampBits;
+            }
+
+            // Outside of a render pass, the pair is reset here so prerecorded buffers can be resubmitted
+            void beginTimestamp(VkCommandBuffer& buffer, uint32_t frame, uint32_t pass) {
+                if (passBits(pass) == 0)
+                    return;
+
+                uint32_t query = (frame * timestampPasses + pass) * 2;
+
+                vkCmdResetQueryPool(buffer, timestampPool, query, 2);
+                vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, query);
+            }
+
+            void endTimestamp(VkCommandBuffer& buffer, uint32_t frame, uint32_t pass) {
+                if (passBits(pass) == 0)
+                    return;
+
+                uint32_t query = (frame * timestampPasses + pass) * 2;
+
+                vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, query + 1);
+            }
+
+            // Milliseconds per pass from the last finished submission of frame,
+            // never waits. Passes that did not run come back negative
+            void timestamps(uint32_t frame, std::vector<float>& ms) {
+                // Value and availability per query
+                std::vector<uint64_t> results(timestampPasses * 4);
+
+                vkGetQueryPoolResults(device, timestampPool, frame * timestampPasses * 2, timestampPasses * 2,
+                        results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+                        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+                ms.resize(timestampPasses);
+                for (uint32_t pass = 0; pass < timestampPasses; pass++) {
+                    uint64_t* begin = &results[pass * 4];
+                    uint64_t* end = &results[pass * 4 + 2];
+
+                    if (begin[1] && end[1] && passBits(pass) > 0)
+                        ms[pass] = static_cast<float>(elapsed(begin[0], end[0], passBits(pass)) / 1e6);
+                    else ms[pass] = -1.0f;
+                }
+            }
 
         private:
             bool enableValidationLayers;
+            bool headless;
+
+            VkQueryPool timestampPool = VK_NULL_HANDLE;
+            uint32_t timestampPasses = 0;
+            uint32_t timestampComputePasses = 0;
+            uint32_t timestampQueries = 0;
 
             VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
             VkDevice device;
@@ -459,10 +657,10 @@ namespace hw {
             bool isDeviceSuitable(VkPhysicalDevice _physicalDevice) {
                 QueueFamilyIndices indices = findQueueFamilies(_physicalDevice);
 
-                bool extensionsSupported = checkDeviceExtensionSupport(_physicalDevice);
+                bool extensionsSupported = headless || checkDeviceExtensionSupport(_physicalDevice);
 
-                bool swapChainAdequate = false;
-                if (extensionsSupported) {
+                bool swapChainAdequate = headless;
+                if (extensionsSupported && !headless) {
                     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(_physicalDevice);
                     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
                 }
@@ -470,7 +668,23 @@ namespace hw {
                 VkPhysicalDeviceFeatures supportedFeatures;
                 vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
 
-                return indices.isComplete() && extensionsSupported && swapChainAdequate  && supportedFeatures.samplerAnisotropy;
+                VkPhysicalDeviceProperties properties;
+                vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+
+                VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+                vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+                VkPhysicalDeviceFeatures2 features2 = {};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+                features2.pNext = &vulkan12Features;
+
+                bool timelineSupported = properties.apiVersion >= VK_API_VERSION_1_2;
+                if (timelineSupported) {
+                    vkGetPhysicalDeviceFeatures2(_physicalDevice, &features2);
+                    timelineSupported = vulkan12Features.timelineSemaphore;
+                }
+
+                return indices.isComplete() && extensionsSupported && swapChainAdequate  && supportedFeatures.samplerAnisotropy && timelineSupported;
             }
 
             bool checkDeviceExtensionSupport(VkPhysicalDevice _physicalDevice) {
@@ -508,8 +722,9 @@ namespace hw {
                         indices.computeFamily = i;
                     }
 
-                    VkBool32 presentSupport = false;
-                    vkGetPhysicalDeviceSurfaceSupportKHR(_physicalDevice, i, hw::loc::surface()->get(), &presentSupport);
+                    VkBool32 presentSupport = headless && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+                    if (!headless)
+                        vkGetPhysicalDeviceSurfaceSupportKHR(_physicalDevice, i, hw::loc::surface()->get(), &presentSupport);
 
                     if (presentSupport) {
                         indices.presentFamily = i;
@@ -522,6 +737,10 @@ namespace hw {
                     i++;
                 }
 
+                // Single family devices like lavapipe share the graphics queue
+                if (!indices.computeFamily.has_value() && indices.graphicsFamily.has_value())
+                    indices.computeFamily = indices.graphicsFamily;
+
                 return indices;
             }
 
@@ -49,7 +49,8 @@ class ImGuiImpl {
             return commandBuffers[index];
         }
 
-        void recordCommandBuffer(uint32_t imageIndex) {
+        // timestampPass is the slot in the device's timestamp pool
+        void recordCommandBuffer(uint32_t imageIndex, uint32_t timestampPass) {
             VkCommandBufferBeginInfo info = {};
             info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
             info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
@@ -57,6 +58,8 @@ class ImGuiImpl {
                 throw std::runtime_error("failed to begin imgui command buffer");
             }
 
+            hw::loc::device()->beginTimestamp(commandBuffers[imageIndex], imageIndex, timestampPass);
+
             VkRenderPassBeginInfo beginInfo = {};
             beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
             beginInfo.renderPass = imguiRenderPass;
@@ -74,6 +77,8 @@ class ImGuiImpl {
             ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffers[imageIndex]);
 
             vkCmdEndRenderPass(commandBuffers[imageIndex]);
+            hw::loc::device()->endTimestamp(commandBuffers[imageIndex], imageIndex, timestampPass);
+
             if (vkEndCommandBuffer(commandBuffers[imageIndex]) != VK_SUCCESS) {
                 throw std::runtime_error("failed to end imgui command buffer");
             }
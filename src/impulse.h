@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// How an impulse changes the cells it covers, see simulation_splat.comp
+enum ImpulseShape : uint32_t {
+    IMPULSE_BOX,    // sets a square of half width radius, like the old mouse splat
+    IMPULSE_DISC,   // sets a disc
+    IMPULSE_DROP,   // adds a smooth bump that falls to zero at radius
+};
+
+// Same layout as Impulse in the shaders: 2 x vec4
+struct alignas(16) Impulse {
+    float x = 0.0f;
+    float y = 0.0f;
+    float radius = 2.0f;
+    float amplitude = -2.0f;
+    uint32_t shape = IMPULSE_BOX;
+    uint32_t pad[3] = {};
+};
+
+const uint32_t MAX_IMPULSES = 64;
+
+// Height of a cell dx, dy cells from the centre once the impulse hit it,
+// only called for the covered square. Mirrors simulation_splat.comp
+inline float impulseHeight(const Impulse& impulse, float dx, float dy, float height) {
+    float falloff = (dx * dx + dy * dy) / (impulse.radius * impulse.radius);
+
+    switch (impulse.shape) {
+        case IMPULSE_BOX: return impulse.amplitude;
+        case IMPULSE_DISC: return (falloff <= 1.0f) ? impulse.amplitude : height;
+        case IMPULSE_DROP: return (falloff < 1.0f) ? height + impulse.amplitude * (1.0f - falloff) * (1.0f - falloff) : height;
+        default: return height;
+    }
+}
+
+// Procedural drops of simulation_rain.comp, at most one per workgroup sized block and dispatch
+struct Rain {
+    // Seeds the hash, the batch's dispatches add their index
+    uint32_t step = 0;
+    // Chance of a drop per block
+    float rate = 0.0f;
+    // Cells, no larger than a workgroup or drops get cut off
+    float radius = 3.0f;
+    float amplitude = -0.5f;
+};
+
+// Indirect dispatch arguments, one workgroup per impulse, then the same for
+// the rain pass (x is 0 while it is dry), then the parameters of both
+struct ImpulseBatch {
+    std::array<uint32_t, 4> command = {0, 1, 1, 0};
+    std::array<uint32_t, 4> rainCommand = {0, 1, 1, 0};
+    Rain rain;
+    std::array<Impulse, MAX_IMPULSES> impulses;
+};
+
+// Bounded ring of the impulses waiting for the next step, the oldest is
+// dropped when more than MAX_IMPULSES arrive in between
+class ImpulseQueue {
+    public:
+        void push(const Impulse& impulse) {
+            entries[(first + count) % MAX_IMPULSES] = impulse;
+
+            if (count < MAX_IMPULSES)
+                count++;
+            else first = (first + 1) % MAX_IMPULSES;
+        }
+
+        // Writes every waiting impulse into batch, which may be mapped device memory
+        void drain(ImpulseBatch& batch) {
+            for (uint32_t i = 0; i < count; i++)
+                batch.impulses[i] = entries[(first + i) % MAX_IMPULSES];
+
+            batch.command = {count, 1, 1, 0};
+            first = 0;
+            count = 0;
+        }
+
+        uint32_t size() {
+            return count;
+        }
+
+    private:
+        std::array<Impulse, MAX_IMPULSES> entries;
+        uint32_t first = 0;
+        uint32_t count = 0;
+};
@@ -14,7 +14,7 @@ namespace hw {
 
     class Instance {
         public:
-            Instance(bool _validation) : enableValidationLayers(_validation) {
+            Instance(bool _validation, bool _headless=false) : enableValidationLayers(_validation), headless(_headless) {
                 if (volkInitialize() != VK_SUCCESS) {
                     throw std::runtime_error("couldn't initialize Volk!");
                 }
@@ -29,7 +29,7 @@ namespace hw {
                 appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
                 appInfo.pEngineName = "Hova's Engine";
                 appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-                appInfo.apiVersion = VK_API_VERSION_1_0;
+                appInfo.apiVersion = VK_API_VERSION_1_2;
 
                 VkInstanceCreateInfo createInfo = {};
                 createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -78,6 +78,7 @@ namespace hw {
 
         private:
             bool enableValidationLayers;
+            bool headless;
             VkInstance instance;
             VkDebugUtilsMessengerEXT debugMessenger;
 
@@ -137,11 +138,16 @@ namespace hw {
             }
 
             std::vector<const char*> getRequiredExtensions() {
-                uint32_t glfwExtensionCount = 0;
-                const char** glfwExtensions;
-                glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+                std::vector<const char*> extensions;
 
-                std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+                // Without a window there is nothing to present to
+                if (!headless) {
+                    uint32_t glfwExtensionCount = 0;
+                    const char** glfwExtensions;
+                    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+                    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+                }
 
                 if (enableValidationLayers) {
                     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
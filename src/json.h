@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace json {
+    // Contents of a JSON string, quotes, backslashes and control characters escaped
+    inline std::string escape(std::string_view text) {
+        std::string escaped;
+        escaped.reserve(text.size());
+
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char code[7];
+                std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+                escaped += code;
+            } else escaped += c;
+        }
+
+        return escaped;
+    }
+}
@@ -24,7 +24,7 @@ struct Mesh {
 
             descriptor.start = start;
             descriptor.size = size;
-            read::quad(_dimensions, hw::loc::vertices(), hw::loc::indices(), vertex.start, vertex.size);
+            read::quad(_dimensions, hw::loc::vertices(), hw::loc::indices(), vertex.start, index.start, index.size);
             simple = true;
         }
 
@@ -46,7 +46,7 @@ struct Mesh {
 
             descriptor.start = start;
             descriptor.size = size;
-            read::model(model.data(), hw::loc::vertices(), hw::loc::indices(), vertex.start, vertex.size);
+            read::model(model.data(), hw::loc::vertices(), hw::loc::indices(), vertex.start, index.start, index.size);
         }
 
     ~Mesh() {
@@ -63,11 +63,16 @@ struct Mesh {
     glm::vec3 rotation;
     glm::vec3 scale;
 
+    // First vertex of the mesh, its indices count from there
     struct VertexBufferInfo {
         uint32_t start;
-        uint32_t size;
     } vertex;
 
+    struct IndexBufferInfo {
+        uint32_t start;
+        uint32_t size;
+    } index;
+
     struct DescriptorData {
         uint32_t start;
         uint32_t size;
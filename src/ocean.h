@@ -0,0 +1,390 @@
+#pragma once
+
+#include <volk.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "locator.h"
+#include "device.h"
+#include "command.h"
+#include "create.h"
+#include "shader.h"
+
+// Wave spectra the ocean can start from, both spread as cos² around the wind
+enum OceanSpectrum : uint32_t {
+    SPECTRUM_PHILLIPS,
+    SPECTRUM_JONSWAP,
+};
+
+struct OceanSettings {
+    // FFT size, a power of two of at least 32
+    uint32_t size = 256;
+    // Metres one tile of the field covers
+    float length = 250.0f;
+    // Metres per second, the direction is the one the waves travel in
+    glm::vec2 wind = glm::vec2(12.0f, 4.0f);
+    // Metres of open water upwind, only JONSWAP looks at it
+    float fetch = 100000.0f;
+    // Standard deviation the height is scaled to, in the units of the simulation ring
+    float rms = 0.12f;
+    // Seconds after which the waves repeat exactly, keeps the clock small
+    float period = 200.0f;
+    OceanSpectrum spectrum = SPECTRUM_PHILLIPS;
+    uint32_t seed = 1;
+};
+
+// Specialization constants of the ocean_*.comp shaders
+struct OceanConstants {
+    uint32_t groupX = 16;
+    uint32_t groupY = 16;
+    uint32_t size = 256;
+    uint32_t stages = 8;
+    float length = 250.0f;
+    float period = 200.0f;
+    float gravity = 9.81f;
+    float scale = 1.0f;
+};
+
+// Tessendorf ocean: a spectrum drawn once on the host, evolved in time and brought to the
+// spatial domain by a radix-2 Stockham FFT every dispatch. field() then holds the tileable
+// height in .r, already scaled to settings.rms
+class Ocean {
+    public:
+        static constexpr float GRAVITY = 9.81f;
+        static const uint32_t GROUP = 16;
+
+        VkImage& field() {
+            return images[FIELD];
+        }
+
+        VkImageView& fieldView() {
+            return imageViews[FIELD];
+        }
+
+        uint32_t size() {
+            return constants.size;
+        }
+
+        // Seconds of the frame's first dispatch and the time every further one adds
+        void clock(uint32_t frame, float seconds, float tick) {
+            float* time = static_cast<float*>(clockMapped[frame]);
+            time[0] = std::fmod(seconds, settings.period);
+            time[1] = tick;
+        }
+
+        // Spectrum at the time of the dispatch, then the rows and the columns, ping-ponging so
+        // the result ends up in FIELD again. Leaves the ocean's pipeline and set bound
+        void record(VkCommandBuffer& buffer, uint32_t frame, uint32_t dispatch) {
+            vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &sets[frame], 0, nullptr);
+
+            std::array<uint32_t, 2> push = {0, dispatch};
+
+            hw::loc::comp()->barrier(buffer,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+            vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[SPECTRUM_PIPELINE]);
+            vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), push.data());
+            vkCmdDispatch(buffer, constants.size / GROUP, constants.size / GROUP, 1);
+
+            vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[FFT_PIPELINE]);
+            for (uint32_t pass = 0; pass < 2 * constants.stages; pass++) {
+                hw::loc::comp()->barrier(buffer,
+                        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+                push[0] = pass;
+                vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), push.data());
+                vkCmdDispatch(buffer, constants.size / 2 / GROUP, constants.size / GROUP, 1);
+            }
+        }
+
+        // frames is how many clocks the ocean keeps, one per prerecorded frame
+        Ocean(const OceanSettings& _settings, uint32_t frames=1) : settings(_settings) {
+            if (settings.size < 32 || (settings.size & (settings.size - 1)) != 0)
+                throw std::runtime_error("ocean size has to be a power of two of at least 32!");
+
+            constants.groupX = GROUP;
+            constants.groupY = GROUP;
+            constants.size = settings.size;
+            constants.stages = static_cast<uint32_t>(std::log2(settings.size));
+            constants.length = settings.length;
+            constants.period = settings.period;
+            constants.gravity = GRAVITY;
+
+            initImages();
+            initSpectrum();
+            initClocks(frames);
+            initDescriptors(frames);
+
+            addPipeline("shaders/ocean_spectrum.comp.spv");
+            addPipeline("shaders/ocean_fft.comp.spv");
+        }
+
+        ~Ocean() {
+            for (auto& pipe : pipelines)
+                hw::loc::device()->destroy(pipe);
+
+            hw::loc::device()->destroy(pipelineLayout);
+            hw::loc::device()->destroy(pool);
+            hw::loc::device()->destroy(setLayout);
+
+            for (uint32_t i = 0; i < clockBuffers.size(); i++) {
+                hw::loc::device()->unmap(clockMemory[i]);
+                hw::loc::device()->destroy(clockBuffers[i]);
+                hw::loc::device()->free(clockMemory[i]);
+            }
+
+            for (uint32_t i = 0; i < images.size(); i++) {
+                hw::loc::device()->destroy(imageViews[i]);
+                hw::loc::device()->destroy(images[i]);
+                hw::loc::device()->free(imageMemory[i]);
+            }
+        }
+
+    private:
+        // h0(k) in .xy and conj(h0(-k)) in .zw, then the two halves of the FFT ping-pong
+        enum OceanImage : uint32_t { SPECTRUM, FIELD, SCRATCH, IMAGE_COUNT };
+        enum OceanPipeline : uint32_t { SPECTRUM_PIPELINE, FFT_PIPELINE };
+
+        static constexpr VkFormat FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+
+        OceanSettings settings;
+        OceanConstants constants;
+
+        std::array<VkImage, IMAGE_COUNT> images;
+        std::array<VkImageView, IMAGE_COUNT> imageViews;
+        std::array<VkDeviceMemory, IMAGE_COUNT> imageMemory;
+
+        std::vector<VkBuffer> clockBuffers;
+        std::vector<VkDeviceMemory> clockMemory;
+        std::vector<void*> clockMapped;
+
+        VkDescriptorSetLayout setLayout;
+        VkDescriptorPool pool;
+        VkPipelineLayout pipelineLayout;
+        std::vector<VkDescriptorSet> sets;
+        std::vector<VkPipeline> pipelines;
+
+        void initImages() {
+            for (uint32_t i = 0; i < IMAGE_COUNT; i++) {
+                create::image(settings.size, settings.size, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, images[i], imageMemory[i], FORMAT);
+                imageViews[i] = create::imageView(images[i], FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+            }
+
+            for (uint32_t i = FIELD; i < IMAGE_COUNT; i++)
+                hw::loc::comp()->transitionImageLayout(images[i], FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        // Energy of a wave vector before the random amplitude, any constant factor
+        // drops out when the field is scaled to settings.rms
+        float spectrum(glm::vec2 k) {
+            float length = glm::length(k);
+            if (length < 1e-6f)
+                return 0.0f;
+
+            float speed = glm::length(settings.wind);
+            float align = glm::dot(k / length, settings.wind / speed);
+            float spread = align * align;
+
+            if (settings.spectrum == SPECTRUM_PHILLIPS) {
+                // Largest wave the wind raises and the ripples below a thousandth of it
+                float largest = speed * speed / GRAVITY;
+                float smallest = largest / 1000.0f;
+
+                return std::exp(-1.0f / (length * largest * length * largest)) / std::pow(length, 4.0f)
+                    * spread * std::exp(-length * length * smallest * smallest);
+            }
+
+            // JONSWAP over frequency, moved to wave numbers with deep water dispersion
+            float omega = std::sqrt(GRAVITY * length);
+            float peak = 22.0f * std::cbrt(GRAVITY * GRAVITY / (speed * settings.fetch));
+            float sigma = (omega <= peak) ? 0.07f : 0.09f;
+            float r = std::exp(-(omega - peak) * (omega - peak) / (2.0f * sigma * sigma * peak * peak));
+
+            float energy = GRAVITY * GRAVITY / std::pow(omega, 5.0f) * std::exp(-1.25f * std::pow(peak / omega, 4.0f)) * std::pow(3.3f, r);
+            float slope = GRAVITY / (2.0f * omega);
+
+            return energy * slope / length * spread;
+        }
+
+        // Gaussian amplitudes for every wave vector, and the scale that gives the
+        // unnormalised inverse FFT a standard deviation of settings.rms
+        void initSpectrum() {
+            uint32_t n = settings.size;
+            std::mt19937 random(settings.seed);
+            std::normal_distribution<float> gauss;
+
+            std::vector<std::complex<float>> h0(n * n);
+            for (uint32_t y = 0; y < n; y++)
+                for (uint32_t x = 0; x < n; x++) {
+                    glm::vec2 k = glm::vec2(static_cast<float>(x) - n / 2.0f, static_cast<float>(y) - n / 2.0f) * 2.0f * glm::pi<float>() / settings.length;
+                    h0[y * n + x] = std::complex<float>(gauss(random), gauss(random)) * std::sqrt(spectrum(k) / 2.0f);
+                }
+
+            std::vector<float> texels(n * n * 4);
+            double energy = 0.0;
+
+            for (uint32_t y = 0; y < n; y++)
+                for (uint32_t x = 0; x < n; x++) {
+                    std::complex<float> k = h0[y * n + x];
+                    std::complex<float> minus = std::conj(h0[((n - y) % n) * n + (n - x) % n]);
+
+                    float* texel = &texels[(y * n + x) * 4];
+                    texel[0] = k.real();
+                    texel[1] = k.imag();
+                    texel[2] = minus.real();
+                    texel[3] = minus.imag();
+
+                    energy += std::norm(k) + std::norm(minus);
+                }
+
+            constants.scale = (energy > 0.0) ? settings.rms / static_cast<float>(std::sqrt(energy)) : 0.0f;
+
+            VkBuffer stagingBuffer;
+            VkDeviceMemory stagingBufferMemory;
+            VkDeviceSize bytes = texels.size() * sizeof(float);
+
+            create::buffer(bytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+            void* data;
+            hw::loc::device()->map(stagingBufferMemory, bytes, data);
+            memcpy(data, texels.data(), bytes);
+            hw::loc::device()->unmap(stagingBufferMemory);
+
+            hw::loc::comp()->transitionImageLayout(images[SPECTRUM], FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            hw::loc::comp()->copyBufferToImage(stagingBuffer, images[SPECTRUM], n, n);
+            hw::loc::comp()->transitionImageLayout(images[SPECTRUM], FORMAT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+
+            hw::loc::device()->destroy(stagingBuffer);
+            hw::loc::device()->free(stagingBufferMemory);
+        }
+
+        void initClocks(uint32_t frames) {
+            clockBuffers.resize(frames);
+            clockMemory.resize(frames);
+            clockMapped.resize(frames);
+
+            for (uint32_t i = 0; i < frames; i++) {
+                create::buffer(sizeof(glm::vec4), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, clockBuffers[i], clockMemory[i]);
+                hw::loc::device()->map(clockMemory[i], sizeof(glm::vec4), clockMapped[i]);
+                clock(i, 0.0f, 0.0f);
+            }
+        }
+
+        // Set of a frame: the three images, then its clock
+        void initDescriptors(uint32_t frames) {
+            std::array<VkDescriptorSetLayoutBinding, IMAGE_COUNT + 1> bindings = {};
+            for (uint32_t i = 0; i < bindings.size(); i++) {
+                bindings[i].binding = i;
+                bindings[i].descriptorCount = 1;
+                bindings[i].descriptorType = (i == IMAGE_COUNT) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            }
+
+            VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+            layoutInfo.pBindings = bindings.data();
+            hw::loc::device()->create(layoutInfo, setLayout);
+
+            // Pass, then the dispatch within the frame
+            VkPushConstantRange range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, 2 * sizeof(uint32_t)};
+
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pipelineLayoutInfo.setLayoutCount = 1;
+            pipelineLayoutInfo.pSetLayouts = &setLayout;
+            pipelineLayoutInfo.pushConstantRangeCount = 1;
+            pipelineLayoutInfo.pPushConstantRanges = &range;
+            hw::loc::device()->create(pipelineLayoutInfo, pipelineLayout);
+
+            std::array<VkDescriptorPoolSize, 2> poolSizes = {{
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, IMAGE_COUNT * frames},
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frames},
+            }};
+
+            VkDescriptorPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+            poolInfo.pPoolSizes = poolSizes.data();
+            poolInfo.maxSets = frames;
+            hw::loc::device()->create(poolInfo, pool);
+
+            std::vector<VkDescriptorSetLayout> layouts(frames, setLayout);
+            sets.resize(frames);
+
+            VkDescriptorSetAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = pool;
+            allocInfo.descriptorSetCount = frames;
+            allocInfo.pSetLayouts = layouts.data();
+            hw::loc::device()->allocate(allocInfo, sets.data());
+
+            for (uint32_t f = 0; f < frames; f++) {
+                std::array<VkDescriptorImageInfo, IMAGE_COUNT> imageInfos = {};
+                std::array<VkWriteDescriptorSet, IMAGE_COUNT + 1> writes = {};
+                VkDescriptorBufferInfo clockInfo = {clockBuffers[f], 0, sizeof(glm::vec4)};
+
+                for (uint32_t i = 0; i < writes.size(); i++) {
+                    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    writes[i].dstSet = sets[f];
+                    writes[i].dstBinding = i;
+                    writes[i].descriptorCount = 1;
+                    writes[i].descriptorType = bindings[i].descriptorType;
+
+                    if (i == IMAGE_COUNT) {
+                        writes[i].pBufferInfo = &clockInfo;
+                        continue;
+                    }
+
+                    imageInfos[i].imageView = imageViews[i];
+                    imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                    writes[i].pImageInfo = &imageInfos[i];
+                }
+
+                hw::loc::device()->update(static_cast<uint32_t>(writes.size()), writes.data());
+            }
+        }
+
+        void addPipeline(std::string_view file) {
+            Shader shader(file.data(), VK_SHADER_STAGE_COMPUTE_BIT);
+
+            std::array<VkSpecializationMapEntry, 8> entries = {{
+                {0, offsetof(OceanConstants, groupX), sizeof(uint32_t)},
+                {1, offsetof(OceanConstants, groupY), sizeof(uint32_t)},
+                {2, offsetof(OceanConstants, size), sizeof(uint32_t)},
+                {3, offsetof(OceanConstants, stages), sizeof(uint32_t)},
+                {4, offsetof(OceanConstants, length), sizeof(float)},
+                {5, offsetof(OceanConstants, period), sizeof(float)},
+                {6, offsetof(OceanConstants, gravity), sizeof(float)},
+                {7, offsetof(OceanConstants, scale), sizeof(float)},
+            }};
+
+            VkSpecializationInfo specializationInfo = {};
+            specializationInfo.mapEntryCount = static_cast<uint32_t>(entries.size());
+            specializationInfo.pMapEntries = entries.data();
+            specializationInfo.dataSize = sizeof(constants);
+            specializationInfo.pData = &constants;
+
+            VkComputePipelineCreateInfo pipelineInfo = {};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipelineInfo.layout = pipelineLayout;
+            pipelineInfo.stage = shader.info();
+            pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+
+            pipelines.resize(pipelines.size() + 1);
+            hw::loc::device()->create(pipelineInfo, pipelines[pipelines.size() - 1]);
+        }
+};
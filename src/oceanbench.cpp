@@ -0,0 +1,109 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+
+#include <volk.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "create.h"
+#include "ocean.h"
+
+// Headless GPU cost of one ocean dispatch (spectrum and both FFT directions),
+// prints one JSON object per size.
+// ocean_bench [--sizes 256,512,1024] [--dispatches N] [--spectrum phillips|jonswap]
+
+const std::map<std::string, OceanSpectrum> spectra = {
+    {"phillips", SPECTRUM_PHILLIPS},
+    {"jonswap", SPECTRUM_JONSWAP},
+};
+
+class OceanBench : public bench::Harness {
+    public:
+        OceanBench() {
+            hw::loc::comp()->createCommandBuffers(commandBuffers, 1);
+        }
+
+        ~OceanBench() {
+            hw::loc::device()->waitDevice();
+            hw::loc::comp()->freeCommandBuffers(commandBuffers);
+        }
+
+        // GPU nanoseconds for the given number of dispatches, spaced a 60th of a second apart
+        double run(Ocean& ocean, uint32_t dispatches) {
+            ocean.clock(0, 0.0f, 1.0f / 60.0f);
+
+            return time(commandBuffers[0], [&](VkCommandBuffer& buffer) {
+                for (uint32_t d = 0; d < dispatches; d++)
+                    ocean.record(buffer, 0, d);
+            });
+        }
+
+    private:
+        std::vector<VkCommandBuffer> commandBuffers;
+};
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::string> args = {
+        {"sizes", "256,512,1024"}, {"dispatches", "200"}, {"spectrum", "jonswap"},
+    };
+
+    if (!bench::parse(argc, argv, args))
+        return EXIT_FAILURE;
+
+    if (!spectra.count(args["spectrum"])) {
+        std::cerr << "unknown spectrum" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint32_t> sizes;
+    for (size_t start = 0; start < args["sizes"].size();) {
+        size_t end = std::min(args["sizes"].find(',', start), args["sizes"].size());
+        sizes.push_back(std::stoul(args["sizes"].substr(start, end - start)));
+        start = end + 1;
+    }
+
+    uint32_t dispatches = std::max(std::stoul(args["dispatches"]), 1ul);
+
+    try {
+        OceanBench bench;
+
+        for (uint32_t size : sizes) {
+            OceanSettings settings;
+            settings.size = size;
+            settings.spectrum = spectra.at(args["spectrum"]);
+            Ocean ocean(settings);
+
+            // First run pays for pipeline and cache warm up
+            bench.run(ocean, std::min(dispatches, 16u));
+            double ns = bench.run(ocean, dispatches);
+
+            // A radix-2 pass per stage and direction, plus the spectrum
+            uint32_t stages = 0;
+            while ((1u << stages) < size)
+                stages++;
+
+            std::cout << bench.device()
+                << "\"spectrum\": \"" << args["spectrum"] << "\", "
+                << "\"size\": " << size << ", "
+                << "\"passes\": " << 2 * stages + 1 << ", "
+                << "\"dispatches\": " << dispatches << ", "
+                << "\"total_ms\": " << ns / 1e6 << ", "
+                << "\"ms_per_dispatch\": " << ns / 1e6 / dispatches << ", "
+                << "\"ns_per_cell\": " << ns / (static_cast<double>(size) * size * dispatches)
+                << "}" << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -13,6 +13,7 @@
 #include "vertex.h"
 
 namespace read {
+    // Four corners, the faces point both ways
     void quad(glm::vec2 dimensions, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
         std::vector<glm::vec3> generatedVertices = {
             glm::vec3(dimensions.x / 2, dimensions.y / 2, 0.0f),
@@ -28,42 +29,51 @@ namespace read {
             glm::vec2(1.0, 1.0),
         };
 
-        std::vector<uint32_t> generatedIndeces = {
+        indices = {
             0, 1, 2,
             1, 2, 3,
             0, 2, 1,
             1, 3, 2,
         };
 
-        for (auto& elem: generatedIndeces) {
+        for (size_t i = 0; i < generatedVertices.size(); i++) {
             Vertex vertex = {};
 
-            vertex.pos = generatedVertices[elem];
+            vertex.pos = generatedVertices[i];
 
-            vertex.texCoord = generatedTex[elem];
+            vertex.texCoord = generatedTex[i];
 
             vertex.normals = {0.0f, 0.0f, 0.0f};
 
             vertices.push_back(vertex);
-            indices.push_back(vertices.size() - 1);
         }
     }
 
+    // Appends a mesh whose indices count from its own first vertex, drawn with
+    // vkCmdDrawIndexed(indexCount, 1, firstIndex, firstVertex, 0)
+    void append(const std::vector<Vertex>& _vertices, const std::vector<uint32_t>& _indices, std::vector<Vertex>& vertices,
+            std::vector<uint32_t>& indices, uint32_t& firstVertex, uint32_t& firstIndex, uint32_t& indexCount) {
+
+        firstVertex = vertices.size();
+        firstIndex = indices.size();
+        indexCount = _indices.size();
+
+        vertices.insert(vertices.end(), _vertices.begin(), _vertices.end());
+        indices.insert(indices.end(), _indices.begin(), _indices.end());
+    }
+
     void quad(glm::vec2 dimensions, std::vector<Vertex>& vertices,
-            std::vector<uint32_t>& indices, uint32_t& start, uint32_t& size) {
+            std::vector<uint32_t>& indices, uint32_t& firstVertex, uint32_t& firstIndex, uint32_t& indexCount) {
 
         std::vector<Vertex> _vertices;
         std::vector<uint32_t> _indices;
 
         quad(dimensions, _vertices, _indices);
-
-        size = _indices.size();
-        start = vertices.size();
-
-        vertices.insert(vertices.end(), _vertices.begin(), _vertices.end());
-        indices.insert(indices.end(), _indices.begin(), _indices.end());
+        append(_vertices, _indices, vertices, indices, firstVertex, firstIndex, indexCount);
     }
 
+    // Welds the corners OBJ faces share, every distinct position, normal and
+    // texture coordinate becomes one vertex
     void model(std::string_view filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
@@ -74,6 +84,14 @@ namespace read {
             throw std::runtime_error(warn + err);
         }
 
+        size_t corners = 0;
+        for (const auto& shape : shapes)
+            corners += shape.mesh.indices.size();
+
+        std::unordered_map<Vertex, uint32_t> uniqueVertices;
+        uniqueVertices.reserve(corners);
+        indices.reserve(corners);
+
         for (const auto& shape : shapes) {
             for (const auto& index : shape.mesh.indices) {
                 Vertex vertex = {};
@@ -97,63 +115,23 @@ namespace read {
                     1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
                 };
 
-                vertices.push_back(vertex);
-                indices.push_back(vertices.size() - 1);
+                auto [unique, added] = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(vertices.size()));
+                if (added)
+                    vertices.push_back(vertex);
+
+                indices.push_back(unique->second);
             }
         }
     }
-    /* void model(std::string_view filename, std::vector<Vertex>& vertices, */ 
-    /*         std::vector<uint32_t>& indices) { */
-    /*     tinyobj::attrib_t attrib; */
-    /*     std::vector<tinyobj::shape_t> shapes; */
-    /*     std::vector<tinyobj::material_t> materials; */
-    /*     std::string warn, err; */
 
-    /*     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.data())) { */
-    /*         throw std::runtime_error(warn + err); */
-    /*     } */
-
-    /*     std::unordered_map<Vertex, uint32_t> uniqueVertices = {}; */
-
-    /*     for (const auto& shape : shapes) { */
-    /*         for (const auto& index : shape.mesh.indices) { */
-    /*             Vertex vertex = {}; */
-
-    /*             vertex.pos = { */
-    /*                 attrib.vertices[3 * index.vertex_index + 0], */
-    /*                 attrib.vertices[3 * index.vertex_index + 1], */
-    /*                 attrib.vertices[3 * index.vertex_index + 2] */
-    /*             }; */
-
-    /*             vertex.texCoord = { */
-    /*                 attrib.texcoords[2 * index.texcoord_index + 0], */
-    /*                 1.0f - attrib.texcoords[2 * index.texcoord_index + 1] */
-    /*             }; */
-
-    /*             vertex.normals = {1.0f, 1.0f, 1.0f}; */
-
-    /*             if (uniqueVertices.count(vertex) == 0) { */
-    /*                 uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size()); */
-    /*                 vertices.push_back(vertex); */
-    /*             } */
-
-    /*             indices.push_back(uniqueVertices[vertex]); */
-    /*         } */
-    /*     } */
-    /* } */
-
-    void model(std::string_view filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t& start, uint32_t& size) {
+    void model(std::string_view filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+            uint32_t& firstVertex, uint32_t& firstIndex, uint32_t& indexCount) {
 
         std::vector<Vertex> _vertices;
         std::vector<uint32_t> _indices;
 
         model(filename, _vertices, _indices);
-
-        size = _indices.size();
-        start = vertices.size();
-
-        vertices.insert(vertices.end(), _vertices.begin(), _vertices.end());
-        indices.insert(indices.end(), _indices.begin(), _indices.end());
+        append(_vertices, _indices, vertices, indices, firstVertex, firstIndex, indexCount);
     }
 
     std::vector<char> file(std::string_view filename) {
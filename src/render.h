@@ -2,8 +2,10 @@
 #include <volk.h>
 
 #include <string_view>
+#include <algorithm>
 #include <vector>
 
+#include <blur.h>
 #include <create.h>
 #include <locator.h>
 #include <shader.h>
@@ -18,6 +20,8 @@ class Render {
 
         VkImageView& colorView(uint32_t index)
         {
+            if (blur)
+                return blur->view(index);
             if (boolmap.haveFBO)
                 return colorImageViews[index];
             else if (boolmap.havedefaultFBO)
@@ -27,6 +31,8 @@ class Render {
 
         VkSampler& colorSampler(uint32_t index)
         {
+            if (blur)
+                return blur->sampler(index);
             if (boolmap.haveFBO)
                 return colorSamplers[index];
             throw std::runtime_error("Not available with defaultFBO");
@@ -48,6 +54,18 @@ class Render {
             throw std::runtime_error("Not available with defaultFBO");
         }
 
+        // Fraction of the swapchain the FBO covers per side
+        float resolutionScale()
+        {
+            return scale;
+        }
+
+        // Layers of the FBO's images, each drawn as its own view of one multiview pass
+        uint32_t viewCount()
+        {
+            return views;
+        }
+
         VkPipeline& pipeline(uint32_t index)
         {
             return pipelines[index];
@@ -58,23 +76,23 @@ class Render {
             return commandBuffers[index];
         }
 
-        void addPipeline(VkPipelineLayout& layout, std::string_view vertShader, std::string_view geomShader, std::string_view fragShader, bool checkDepth=true, bool lines=false)
+        void addPipeline(VkPipelineLayout& layout, std::string_view vertShader, std::string_view geomShader, std::string_view fragShader, bool checkDepth=true, bool lines=false, bool procedural=false)
         {
             Shader vert(vertShader.data(), VK_SHADER_STAGE_VERTEX_BIT);
             Shader frag(fragShader.data(), VK_SHADER_STAGE_FRAGMENT_BIT);
             Shader geom(geomShader.data(), VK_SHADER_STAGE_GEOMETRY_BIT);
 
             std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {vert.info(), frag.info(), geom.info()};
-            initPipe(shaderStages.data(), shaderStages.size(), layout, checkDepth, lines);
+            initPipe(shaderStages.data(), shaderStages.size(), layout, checkDepth, lines, procedural);
         }
 
-        void addPipeline(VkPipelineLayout& layout, std::string_view vertShader, std::string_view fragShader, bool checkDepth = true, bool lines = false)
+        void addPipeline(VkPipelineLayout& layout, std::string_view vertShader, std::string_view fragShader, bool checkDepth = true, bool lines = false, bool procedural = false)
         {
             Shader vert(vertShader.data(), VK_SHADER_STAGE_VERTEX_BIT);
             Shader frag(fragShader.data(), VK_SHADER_STAGE_FRAGMENT_BIT);
 
             std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {vert.info(), frag.info()};
-            initPipe(shaderStages.data(), shaderStages.size(), layout, checkDepth, lines);
+            initPipe(shaderStages.data(), shaderStages.size(), layout, checkDepth, lines, procedural);
         }
 
         void startPass(uint32_t i) {
@@ -97,6 +115,9 @@ class Render {
 
         void endPass(uint32_t i) {
             vkCmdEndRenderPass(commandBuffer(i));
+
+            if (blur)
+                blur->record(commandBuffer(i), i);
         }
 
         void setToDefaultFBO(uint32_t width = hw::loc::swapChain()->width(), uint32_t height = hw::loc::swapChain()->height())
@@ -146,13 +167,15 @@ class Render {
 
             auto depthFormat = hw::loc::swapChain()->findDepthFormat();
 
+            VkImageViewType viewType = (views > 1) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+
             for (size_t i = 0; i < frameBuffers.size(); i++) {
-                create::image(width, height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, colorImages[i], colorMemory[i], hw::loc::swapChain()->format());
-                colorImageViews[i] = create::imageView(colorImages[i], hw::loc::swapChain()->format(), VK_IMAGE_ASPECT_COLOR_BIT);
+                create::image(width, height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, colorImages[i], colorMemory[i], hw::loc::swapChain()->format(), 1, views);
+                colorImageViews[i] = create::imageView(colorImages[i], hw::loc::swapChain()->format(), VK_IMAGE_ASPECT_COLOR_BIT, views, viewType);
                 create::sampler(colorSamplers[i]);
 
-                create::image(width, height, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depthImages[i], depthMemory[i], depthFormat);
-                depthImageViews[i] = create::imageView(depthImages[i], depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+                create::image(width, height, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depthImages[i], depthMemory[i], depthFormat, 1, views);
+                depthImageViews[i] = create::imageView(depthImages[i], depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, views, viewType);
                 create::sampler(depthSamplers[i]);
 
                 std::array<VkImageView, 2> attachments = {
@@ -175,8 +198,27 @@ class Render {
             boolmap.haveFBO = true;
         }
 
-        Render(std::string_view _tag, VkImageLayout colorFinal = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VkImageLayout depthFinal = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-            : tag(_tag) {
+        // FBO at a fraction of the swapchain per side, 0.5 draws a quarter of the fragments.
+        // Samplers of colorView() filter it back up
+        void initScaledFBO(float _scale)
+        {
+            scale = _scale;
+            initFBO(std::max(1u, static_cast<uint32_t>(hw::loc::swapChain()->width() * scale)),
+                    std::max(1u, static_cast<uint32_t>(hw::loc::swapChain()->height() * scale)));
+        }
+
+        // Blurs the color images after every pass, colorView() and colorSampler() then
+        // hand out the blurred copy. Needs the FBO and a shader read only final layout
+        void addBlur()
+        {
+            assert(boolmap.haveFBO);
+            blur = new Blur(colorImages, hw::loc::swapChain()->format(), fboExtent, views);
+        }
+
+        // More than one view renders every draw into that many layers, the shaders pick by gl_ViewIndex
+        Render(std::string_view _tag, VkImageLayout colorFinal = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VkImageLayout depthFinal = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                uint32_t _views = 1)
+            : tag(_tag), views(_views) {
 #ifdef IMGUI_ON
                 if (colorFinal == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
                     colorFinal = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -189,6 +231,8 @@ class Render {
         ~Render() {
             hw::loc::cmd()->freeCommandBuffers(commandBuffers);
 
+            delete blur;
+
             if (boolmap.haveFBO) {
                 for (uint32_t i = 0; i < frameBuffers.size(); i++) {
                     hw::loc::device()->destroy(colorImages[i]);
@@ -224,6 +268,9 @@ class Render {
 
         VkRenderPass pass;
         VkExtent2D fboExtent;
+        float scale = 1.0f;
+        uint32_t views;
+        Blur* blur = nullptr;
 
         std::vector<VkFramebuffer> frameBuffers;
         std::vector<VkCommandBuffer> commandBuffers;
@@ -293,37 +340,51 @@ class Render {
             renderPassInfo.dependencyCount = 1;
             renderPassInfo.pDependencies = &dependency;
 
+            uint32_t viewMask = (1u << views) - 1;
+
+            VkRenderPassMultiviewCreateInfo multiviewInfo = {};
+            multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+            multiviewInfo.subpassCount = 1;
+            multiviewInfo.pViewMasks = &viewMask;
+
+            if (views > 1)
+                renderPassInfo.pNext = &multiviewInfo;
+
             hw::loc::device()->create(renderPassInfo, pass);
         }
 
-        void initPipe(const VkPipelineShaderStageCreateInfo* stages, uint32_t size, VkPipelineLayout& layout, bool checkDepth = true, bool lines = false) {
+        // Procedural pipelines read no vertex buffer, their vertex shader builds
+        // triangle strips from the vertex and instance index
+        void initPipe(const VkPipelineShaderStageCreateInfo* stages, uint32_t size, VkPipelineLayout& layout, bool checkDepth = true, bool lines = false, bool procedural = false) {
             VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
             vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
             auto bindingDescription = Vertex::getBindingDescription();
             auto attributeDescriptions = Vertex::getAttributeDescriptions();
 
-            vertexInputInfo.vertexBindingDescriptionCount = 1;
-            vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-            vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-            vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+            if (!procedural) {
+                vertexInputInfo.vertexBindingDescriptionCount = 1;
+                vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+                vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+                vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+            }
 
             VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
             inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-            inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+            inputAssembly.topology = procedural ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
             inputAssembly.primitiveRestartEnable = VK_FALSE;
 
             VkViewport viewport = {};
             viewport.x = 0.0f;
             viewport.y = 0.0f;
-            viewport.width = (float)hw::loc::swapChain()->width();
-            viewport.height = (float)hw::loc::swapChain()->height();
+            viewport.width = (float)fboExtent.width;
+            viewport.height = (float)fboExtent.height;
             viewport.minDepth = 0.0f;
             viewport.maxDepth = 1.0f;
 
             VkRect2D scissor = {};
             scissor.offset = { 0, 0 };
-            scissor.extent = hw::loc::swapChain()->extent();
+            scissor.extent = fboExtent;
 
             VkPipelineViewportStateCreateInfo viewportState = {};
             viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -0,0 +1,463 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+
+#include <volk.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "create.h"
+#include "compute.h"
+#include "cpusolver.h"
+#include "impulse.h"
+
+// Headless GPU throughput of the simulation kernels, prints one JSON object.
+// sim_bench [--kernel baseline|tiled|subgroup|half|blocked|packed|swe] [--format rgba16f|r16f|r32f]
+//           [--width N] [--height N] [--group-x N] [--group-y N] [--steps N] [--rain drops] [--drift steps]
+//           [--drift-tolerance t] [--cpu steps] [--cpu-tolerance t]
+
+struct BenchKernel {
+    std::string shader;
+    uint32_t images;
+    // Ring turns per dispatch, and solver steps each dispatch covers
+    uint32_t shift;
+    uint32_t steps;
+    // Compulsory texels moved per cell and dispatch, the rest should hit cache
+    uint32_t texels;
+    bool variants;
+    VkFormat format;
+    // Cells one invocation steps along x
+    uint32_t cellsX;
+};
+
+const uint32_t BLOCKED_STEPS = 4;
+
+// Pipelines of the bench's Compute
+const uint32_t BENCH_KERNEL = 0;
+const uint32_t BENCH_RAIN = 1;
+// The fp32 baseline in the same format, what --drift compares against
+const uint32_t BENCH_REFERENCE = 2;
+
+const std::map<std::string, BenchKernel> kernels = {
+    {"baseline", {"simulation", 3, 1, 1, 3, true, VK_FORMAT_UNDEFINED, 1}},
+    {"tiled", {"simulation_tiled", 3, 1, 1, 3, true, VK_FORMAT_UNDEFINED, 1}},
+    {"subgroup", {"simulation_subgroup", 3, 1, 1, 3, true, VK_FORMAT_UNDEFINED, 1}},
+    {"half", {"simulation_half", 3, 1, 1, 3, true, VK_FORMAT_UNDEFINED, 2}},
+    {"blocked", {"simulation_blocked", 4, 2, BLOCKED_STEPS, 4, true, VK_FORMAT_UNDEFINED, 1}},
+    {"packed", {"simulation_packed", 2, 1, 1, 2, false, VK_FORMAT_R16G16_SFLOAT, 1}},
+    {"swe", {"simulation_swe", 2, 1, 1, 2, false, VK_FORMAT_R16G16B16A16_SFLOAT, 1}},
+};
+
+const std::map<std::string, VkFormat> formats = {
+    {"rgba16f", VK_FORMAT_R16G16B16A16_SFLOAT},
+    {"r16f", VK_FORMAT_R16_SFLOAT},
+    {"r32f", VK_FORMAT_R32_SFLOAT},
+};
+
+class SimBench : public bench::Harness {
+    public:
+        SimBench(const BenchKernel& _kernel, VkFormat format, uint32_t width, uint32_t height, uint32_t groupX, uint32_t groupY)
+            : kernel(_kernel) {
+
+                comp = new Compute("bench", kernel.images, width, height, format, 1);
+                comp->constants.steps = BLOCKED_STEPS;
+
+                // Same fallback as Application::addOptionalKernel
+                fallback = (kernel.shader == "simulation_subgroup" && !hw::loc::device()->subgroupShuffle)
+                    || (kernel.shader == "simulation_half" && !hw::loc::device()->shaderFloat16);
+
+                createDescriptors();
+                if (fallback)
+                    comp->addPipeline(pipelineLayout, shaderPath("simulation", true, format), groupX, groupY);
+                else comp->addPipeline(pipelineLayout, shaderPath(kernel.shader, kernel.variants, format), groupX, groupY, kernel.cellsX);
+                comp->addPipeline(pipelineLayout, shaderPath("simulation_rain", true, format), groupX, groupY);
+                comp->addPipeline(pipelineLayout, shaderPath("simulation", kernel.variants, format), groupX, groupY);
+
+                upload(width, height);
+            }
+
+        ~SimBench() {
+            hw::loc::device()->waitDevice();
+
+            delete comp;
+
+            hw::loc::device()->destroy(pipelineLayout);
+            hw::loc::device()->destroy(pool);
+            hw::loc::device()->destroy(setLayout);
+            hw::loc::device()->destroy(impulseBuffer);
+            hw::loc::device()->free(impulseMemory);
+            hw::loc::device()->destroy(activityBuffer);
+            hw::loc::device()->free(activityMemory);
+        }
+
+        // GPU nanoseconds for the given number of dispatches of BENCH_KERNEL or BENCH_RAIN
+        double run(uint32_t dispatches, uint32_t pipeline=BENCH_KERNEL) {
+            return time(comp->commandBuffer(0, 0), [&](VkCommandBuffer& buffer) {
+                vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, comp->pipeline(pipeline));
+
+                for (uint32_t d = 0; d < dispatches; d++) {
+                    hw::loc::comp()->barrier(
+                            buffer,
+                            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                        );
+
+                    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                            &sets[(d * kernel.shift) % comp->size()], 0, nullptr);
+                    vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &d);
+                    comp->dispatch(buffer, pipeline);
+                }
+            });
+        }
+
+        // Drops per dispatch over the whole grid, as Application asks for them
+        void rain(float drops, uint32_t groupX, uint32_t groupY) {
+            float blocks = static_cast<float>((comp->extent().width + groupX - 1) / groupX) * ((comp->extent().height + groupY - 1) / groupY);
+
+            void* data;
+            hw::loc::device()->map(impulseMemory, sizeof(ImpulseBatch), data);
+            ImpulseBatch* batch = static_cast<ImpulseBatch*>(data);
+            batch->rain.rate = std::min(drops / blocks, 1.0f);
+            batch->rain.radius = std::min(3.0f, static_cast<float>(std::min(groupX, groupY)));
+            hw::loc::device()->unmap(impulseMemory);
+        }
+
+        // Largest and RMS difference of the newest level against BENCH_REFERENCE after the same
+        // number of steps from the same start. Only for kernels with the baseline's ring
+        std::pair<float, float> drift(uint32_t dispatches) {
+            if (kernel.images != 3 || kernel.shift != 1)
+                throw std::runtime_error("drift is only measured for kernels on the baseline's ring!");
+
+            return difference(newest(dispatches, BENCH_KERNEL), newest(dispatches, BENCH_REFERENCE));
+        }
+
+        // Largest and RMS difference of CpuSolver against BENCH_REFERENCE after the same number of steps
+        // from the same start, as the CPU sees the uploaded texels. Only for the single level formats
+        std::pair<float, float> cpu(uint32_t steps) {
+            if (kernel.images != 3 || kernel.shift != 1 || kernel.format != VK_FORMAT_UNDEFINED)
+                throw std::runtime_error("the CPU solver is only checked against the baseline's ring and formats!");
+
+            uint32_t width = comp->extent().width;
+            uint32_t height = comp->extent().height;
+
+            std::vector<char> texels(static_cast<size_t>(width) * height * create::texelSize(comp->format()));
+            create::texels(ripples(width, height), comp->format(), texels.data());
+
+            CpuSolver solver(width, height, comp->constants.relax);
+            solver.reset(create::heights(texels.data(), comp->format(), static_cast<size_t>(width) * height));
+            for (uint32_t i = 0; i < steps; i++)
+                solver.step();
+
+            return difference(solver.state(), newest(steps, BENCH_REFERENCE));
+        }
+
+        Compute* comp;
+        // The subgroup or fp16 kernel was asked for, but the device ran the baseline
+        bool fallback = false;
+
+    private:
+        const BenchKernel& kernel;
+
+        VkDescriptorSetLayout setLayout;
+        VkDescriptorPool pool;
+        VkPipelineLayout pipelineLayout;
+        std::vector<VkDescriptorSet> sets;
+
+        VkBuffer impulseBuffer;
+        VkDeviceMemory impulseMemory;
+        VkBuffer activityBuffer;
+        VkDeviceMemory activityMemory;
+
+        // Steps from a fresh upload and reads back the level the last dispatch wrote
+        std::vector<float> newest(uint32_t dispatches, uint32_t pipeline) {
+            uint32_t width = comp->extent().width;
+            uint32_t height = comp->extent().height;
+            upload(width, height);
+            run(dispatches, pipeline);
+
+            VkBuffer readback;
+            VkDeviceMemory readbackMemory;
+            VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * create::texelSize(comp->format());
+            create::buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readback, readbackMemory);
+
+            VkImage& image = comp->color(comp->next(dispatches - 1));
+            hw::loc::comp()->customSingleCommand([&](VkCommandBuffer buffer) {
+                VkBufferImageCopy region = {};
+                region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+                region.imageExtent = {width, height, 1};
+                vkCmdCopyImageToBuffer(buffer, image, VK_IMAGE_LAYOUT_GENERAL, readback, 1, &region);
+                return true;
+            });
+
+            void* data;
+            hw::loc::device()->map(readbackMemory, size, data);
+            std::vector<float> heights = create::heights(data, comp->format(), static_cast<size_t>(width) * height);
+            hw::loc::device()->unmap(readbackMemory);
+
+            hw::loc::device()->destroy(readback);
+            hw::loc::device()->free(readbackMemory);
+            return heights;
+        }
+
+        std::pair<float, float> difference(const std::vector<float>& heights, const std::vector<float>& reference) {
+            double largest = 0.0;
+            double squares = 0.0;
+            for (size_t i = 0; i < heights.size(); i++) {
+                double difference = std::abs(static_cast<double>(heights[i]) - reference[i]);
+                largest = std::max(largest, difference);
+                squares += difference * difference;
+            }
+
+            return {static_cast<float>(largest), static_cast<float>(std::sqrt(squares / heights.size()))};
+        }
+
+        // Gentle ripples everywhere, so no kernel sits on denormals or garbage
+        std::vector<float> ripples(uint32_t width, uint32_t height) {
+            std::vector<float> heights(static_cast<size_t>(width) * height);
+            for (uint32_t y = 0; y < height; y++)
+                for (uint32_t x = 0; x < width; x++)
+                    heights[static_cast<size_t>(y) * width + x] = 0.1f * std::sin(x * 0.05f) * std::cos(y * 0.05f);
+            return heights;
+        }
+
+        void upload(uint32_t width, uint32_t height) {
+            std::vector<float> heights = ripples(width, height);
+
+            // Shallow water keeps its depth in .a
+            glm::vec4 offset = (comp->format() == VK_FORMAT_R16G16B16A16_SFLOAT) ? glm::vec4(0.0f, 0.0f, 0.0f, 10.0f) : glm::vec4(0.0f);
+
+            VkBuffer stagingBuffer;
+            VkDeviceMemory stagingBufferMemory;
+            VkDeviceSize size = heights.size() * create::texelSize(comp->format());
+
+            create::buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+            void* data;
+            hw::loc::device()->map(stagingBufferMemory, size, data);
+            create::texels(heights, comp->format(), data, glm::vec4(1.0f), offset);
+            hw::loc::device()->unmap(stagingBufferMemory);
+
+            for (uint32_t i = 0; i < comp->size(); i++) {
+                hw::loc::comp()->transitionImageLayout(comp->color(i), comp->format(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+                hw::loc::comp()->copyBufferToImage(stagingBuffer, comp->color(i), width, height);
+                hw::loc::comp()->transitionImageLayout(comp->color(i), comp->format(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+            }
+
+            hw::loc::device()->destroy(stagingBuffer);
+            hw::loc::device()->free(stagingBufferMemory);
+        }
+
+        std::string shaderPath(const std::string& shader, bool variants, VkFormat format) {
+            std::string path = "shaders/" + shader;
+
+            if (variants && format == VK_FORMAT_R16_SFLOAT)
+                path += ".r16f";
+            else if (variants && format == VK_FORMAT_R32_SFLOAT)
+                path += ".r32f";
+            else if (variants && format == VK_FORMAT_R16G16_SFLOAT)
+                path += ".rg16f";
+
+            return path + ".comp.spv";
+        }
+
+        // Same bindings as the engine's simulation layout up to the tile activity, with an empty impulse batch
+        void createDescriptors() {
+            std::array<VkDescriptorSetLayoutBinding, 6> bindings = {};
+            for (uint32_t i = 0; i < bindings.size(); i++) {
+                bindings[i].binding = i;
+                bindings[i].descriptorCount = 1;
+                bindings[i].descriptorType = (i == 3 || i == 5) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            }
+
+            VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+            layoutInfo.pBindings = bindings.data();
+            hw::loc::device()->create(layoutInfo, setLayout);
+
+            VkPushConstantRange range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t)};
+
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pipelineLayoutInfo.setLayoutCount = 1;
+            pipelineLayoutInfo.pSetLayouts = &setLayout;
+            pipelineLayoutInfo.pushConstantRangeCount = 1;
+            pipelineLayoutInfo.pPushConstantRanges = &range;
+            hw::loc::device()->create(pipelineLayoutInfo, pipelineLayout);
+
+            std::array<VkDescriptorPoolSize, 2> poolSizes = {{
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4 * comp->size()},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * comp->size()},
+            }};
+
+            VkDescriptorPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+            poolInfo.pPoolSizes = poolSizes.data();
+            poolInfo.maxSets = comp->size();
+            hw::loc::device()->create(poolInfo, pool);
+
+            std::vector<VkDescriptorSetLayout> layouts(comp->size(), setLayout);
+            sets.resize(comp->size());
+
+            VkDescriptorSetAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = pool;
+            allocInfo.descriptorSetCount = comp->size();
+            allocInfo.pSetLayouts = layouts.data();
+            hw::loc::device()->allocate(allocInfo, sets.data());
+
+            create::buffer(sizeof(ImpulseBatch), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, impulseBuffer, impulseMemory);
+
+            void* data;
+            hw::loc::device()->map(impulseMemory, sizeof(ImpulseBatch), data);
+            *static_cast<ImpulseBatch*>(data) = ImpulseBatch();
+            hw::loc::device()->unmap(impulseMemory);
+
+            // One word per cell is more than any group size needs, the rain pass only writes it
+            create::buffer(static_cast<VkDeviceSize>(comp->extent().width) * comp->extent().height * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, activityBuffer, activityMemory);
+
+            for (uint32_t r = 0; r < comp->size(); r++) {
+                std::array<uint32_t, 4> images = {comp->prev(r), comp->curr(r), comp->next(r), comp->after(r)};
+                std::array<VkDescriptorImageInfo, 4> imageInfos = {};
+                std::array<VkWriteDescriptorSet, 6> writes = {};
+
+                VkDescriptorBufferInfo bufferInfo = {impulseBuffer, 0, sizeof(ImpulseBatch)};
+                VkDescriptorBufferInfo activityInfo = {activityBuffer, 0, VK_WHOLE_SIZE};
+
+                for (uint32_t i = 0; i < writes.size(); i++) {
+                    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    writes[i].dstSet = sets[r];
+                    writes[i].dstBinding = i;
+                    writes[i].descriptorCount = 1;
+                    writes[i].descriptorType = bindings[i].descriptorType;
+
+                    if (i == 3 || i == 5) {
+                        writes[i].pBufferInfo = (i == 3) ? &bufferInfo : &activityInfo;
+                        continue;
+                    }
+
+                    uint32_t slot = (i == 4) ? 3 : i;
+                    imageInfos[slot].imageView = comp->colorView(images[slot]);
+                    imageInfos[slot].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                    writes[i].pImageInfo = &imageInfos[slot];
+                }
+
+                hw::loc::device()->update(static_cast<uint32_t>(writes.size()), writes.data());
+            }
+        }
+};
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::string> args = {
+        {"kernel", "baseline"}, {"format", "rgba16f"},
+        {"width", "1024"}, {"height", "1024"},
+        {"group-x", "16"}, {"group-y", "16"},
+        {"steps", "1000"}, {"rain", "0"}, {"drift", "0"}, {"drift-tolerance", "0.01"},
+        {"cpu", "0"}, {"cpu-tolerance", "0.001"},
+    };
+
+    if (!bench::parse(argc, argv, args))
+        return EXIT_FAILURE;
+
+    if (!kernels.count(args["kernel"]) || !formats.count(args["format"])) {
+        std::cerr << "unknown kernel or format" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const BenchKernel& kernel = kernels.at(args["kernel"]);
+    VkFormat format = (kernel.format != VK_FORMAT_UNDEFINED) ? kernel.format : formats.at(args["format"]);
+
+    uint32_t width = std::stoul(args["width"]);
+    uint32_t height = std::stoul(args["height"]);
+    uint32_t groupX = std::stoul(args["group-x"]);
+    uint32_t groupY = std::stoul(args["group-y"]);
+    uint32_t dispatches = std::max(std::stoul(args["steps"]) / kernel.steps, 1ul);
+    float drops = std::stof(args["rain"]);
+    uint32_t driftSteps = std::stoul(args["drift"]);
+    float driftTolerance = std::stof(args["drift-tolerance"]);
+    uint32_t cpuSteps = std::stoul(args["cpu"]);
+    float cpuTolerance = std::stof(args["cpu-tolerance"]);
+
+    try {
+        SimBench bench(kernel, format, width, height, groupX, groupY);
+
+        // First run pays for pipeline and cache warm up
+        bench.run(std::min(dispatches, 16u));
+        double ns = bench.run(dispatches);
+
+        // The rain pass on its own, once per dispatch like in the engine
+        double rainNs = 0.0;
+        if (drops > 0.0f) {
+            bench.rain(drops, groupX, groupY);
+            bench.run(std::min(dispatches, 16u), BENCH_RAIN);
+            rainNs = bench.run(dispatches, BENCH_RAIN);
+        }
+
+        // Error the kernel builds up over the fp32 baseline, meant for --kernel half --drift 10000
+        std::pair<float, float> drift = {0.0f, 0.0f};
+        if (driftSteps > 0)
+            drift = bench.drift(driftSteps);
+
+        // The CPU solver has to track the GPU reference, meant for --format r32f --cpu 1000
+        std::pair<float, float> cpu = {0.0f, 0.0f};
+        if (cpuSteps > 0)
+            cpu = bench.cpu(cpuSteps);
+
+        double cells = static_cast<double>(width) * height;
+        double steps = static_cast<double>(dispatches) * kernel.steps;
+        double bytes = cells * dispatches * kernel.texels * create::texelSize(format);
+
+        std::cout << bench.device()
+            << "\"kernel\": \"" << args["kernel"] << "\", "
+            << "\"format\": \"" << ((kernel.format != VK_FORMAT_UNDEFINED) ? "fixed" : args["format"]) << "\", "
+            << "\"width\": " << width << ", "
+            << "\"height\": " << height << ", "
+            << "\"group_x\": " << groupX << ", "
+            << "\"group_y\": " << groupY << ", "
+            << "\"subgroup_size\": " << hw::loc::device()->subgroupSize << ", "
+            << "\"fallback\": " << (bench.fallback ? "true" : "false") << ", "
+            << "\"steps\": " << static_cast<uint64_t>(steps) << ", "
+            << "\"total_ms\": " << ns / 1e6 << ", "
+            << "\"ns_per_cell\": " << ns / (cells * steps) << ", "
+            << "\"gb_per_s\": " << bytes / ns << ", "
+            << "\"rain_drops\": " << drops << ", "
+            << "\"rain_ms_per_dispatch\": " << rainNs / 1e6 / dispatches << ", "
+            << "\"drift_steps\": " << driftSteps << ", "
+            << "\"drift_max\": " << drift.first << ", "
+            << "\"drift_rms\": " << drift.second << ", "
+            << "\"cpu_steps\": " << cpuSteps << ", "
+            << "\"cpu_max\": " << cpu.first << ", "
+            << "\"cpu_rms\": " << cpu.second
+            << "}" << std::endl;
+
+        if (driftSteps > 0 && drift.first > driftTolerance) {
+            std::cerr << "Kernel drifted " << drift.first << " off the fp32 baseline after " << driftSteps << " steps" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (cpuSteps > 0 && cpu.first > cpuTolerance) {
+            std::cerr << "CPU solver is " << cpu.first << " off the GPU reference after " << cpuSteps << " steps" << std::endl;
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
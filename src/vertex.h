@@ -2,9 +2,10 @@
 
 #include <volk.h>
 #include <glm/glm.hpp>
-#include <glm/gtx/hash.hpp>
 
 #include <array>
+#include <cstdint>
+#include <cstring>
 
 struct Vertex {
     glm::vec3 pos;
@@ -46,10 +47,26 @@ struct Vertex {
     }
 };
 
+// FNV-1a over the bit patterns of the eight floats, adding 0 first so -0 and 0 hash alike
+// like operator== treats them
 namespace std {
     template<> struct hash<Vertex> {
         size_t operator()(Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.normals) << 1)) >> 1) ^ (hash<glm::vec2>()(vertex.texCoord) << 1);
+            const std::array<float, 8> values = {
+                vertex.pos.x, vertex.pos.y, vertex.pos.z,
+                vertex.normals.x, vertex.normals.y, vertex.normals.z,
+                vertex.texCoord.x, vertex.texCoord.y,
+            };
+
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (float value : values) {
+                uint32_t bits;
+                value += 0.0f;
+                memcpy(&bits, &value, sizeof(bits));
+                hash = (hash ^ bits) * 0x100000001b3ull;
+            }
+
+            return static_cast<size_t>(hash);
         }
     };
 }
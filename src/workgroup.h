@@ -0,0 +1,62 @@
+#pragma once
+
+#include <volk.h>
+
+#include <array>
+#include <fstream>
+#include <map>
+#include <string>
+
+// Shapes the auto-tuner tries for the stepping kernel, the ones past the device's limits are skipped
+const std::array<VkExtent2D, 7> WORKGROUP_CANDIDATES = {{
+    {8, 8}, {16, 8}, {16, 16}, {32, 8}, {64, 4}, {32, 16}, {32, 32},
+}};
+
+// sharedBytes is what the kernel's shared arrays take at this shape
+inline bool workgroupFits(const VkPhysicalDeviceLimits& limits, VkExtent2D group, uint32_t sharedBytes) {
+    return group.width <= limits.maxComputeWorkGroupSize[0] && group.height <= limits.maxComputeWorkGroupSize[1]
+        && group.width * group.height <= limits.maxComputeWorkGroupInvocations
+        && sharedBytes <= limits.maxComputeSharedMemorySize;
+}
+
+// Winning shapes from earlier launches, a line of "<key> <x> <y>" each. The key holds
+// the device, the driver version and whatever else the timing depended on
+class WorkgroupCache {
+    public:
+        static std::string key(const VkPhysicalDeviceProperties& properties, const std::string& setup) {
+            return std::to_string(properties.vendorID) + ":" + std::to_string(properties.deviceID) + ":"
+                + std::to_string(properties.driverVersion) + ":" + setup;
+        }
+
+        bool find(const std::string& key, VkExtent2D& group) {
+            auto entry = entries.find(key);
+            if (entry == entries.end())
+                return false;
+
+            group = entry->second;
+            return true;
+        }
+
+        // Rewrites the whole file, it only ever holds a handful of lines
+        void store(const std::string& key, VkExtent2D group) {
+            entries[key] = group;
+
+            std::ofstream file(path, std::ios::trunc);
+            for (auto& [name, shape] : entries)
+                file << name << " " << shape.width << " " << shape.height << "\n";
+        }
+
+        // A missing or unreadable file is an empty cache
+        WorkgroupCache(const std::string& _path) : path(_path) {
+            std::ifstream file(path);
+
+            std::string name;
+            VkExtent2D shape;
+            while (file >> name >> shape.width >> shape.height)
+                entries[name] = shape;
+        }
+
+    private:
+        std::string path;
+        std::map<std::string, VkExtent2D> entries;
+};